@@ -0,0 +1,77 @@
+// Shared by the instance and meshlet culling shaders, see Source/Renderer/IndirectDraw.h.
+// Include after enabling GL_EXT_buffer_reference.
+
+layout(buffer_reference, std430) readonly buffer HiZBuffer { float depth[]; };
+
+layout(buffer_reference, std430) readonly buffer CullViewBuffer
+{
+    vec4 frustumPlanes[6];
+    mat4 viewProj;
+    vec2 hizSize;
+    uint hizMipCount;
+    uint padding0;
+    uint hizMipOffsets[16];
+    vec3 cameraPosition;
+    uint padding1;
+};
+
+bool IsInsideFrustum(CullViewBuffer view, vec3 center, float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(view.frustumPlanes[i].xyz, center) + view.frustumPlanes[i].w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+float SampleHiZ(CullViewBuffer view, HiZBuffer hiz, uint mip, uvec2 mipSize, uvec2 texel)
+{
+    return hiz.depth[view.hizMipOffsets[mip] + texel.y * mipSize.x + texel.x];
+}
+
+// The pyramid stores the farthest depth of each texel footprint, depth 0 is near.
+bool IsOccluded(CullViewBuffer view, HiZBuffer hiz, vec3 center, float radius)
+{
+    vec2 minUV = vec2(1.0);
+    vec2 maxUV = vec2(0.0);
+    float minDepth = 1.0;
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                             (i & 2) != 0 ? 1.0 : -1.0,
+                                             (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = view.viewProj * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+        {
+            // Crosses the camera plane, never occluded
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        minDepth = min(minDepth, ndc.z);
+    }
+
+    minUV = clamp(minUV, vec2(0.0), vec2(1.0));
+    maxUV = clamp(maxUV, vec2(0.0), vec2(1.0));
+
+    // Pick the mip where the footprint covers at most 2x2 texels
+    vec2 extent = (maxUV - minUV) * view.hizSize;
+    uint mip = uint(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    mip = min(mip, view.hizMipCount - 1);
+
+    uvec2 mipSize = max(uvec2(view.hizSize) >> mip, uvec2(1));
+    uvec2 texelMin = min(uvec2(minUV * vec2(mipSize)), mipSize - 1);
+    uvec2 texelMax = min(uvec2(maxUV * vec2(mipSize)), mipSize - 1);
+
+    float maxDepth = max(max(SampleHiZ(view, hiz, mip, mipSize, texelMin),
+                             SampleHiZ(view, hiz, mip, mipSize, uvec2(texelMax.x, texelMin.y))),
+                         max(SampleHiZ(view, hiz, mip, mipSize, uvec2(texelMin.x, texelMax.y)),
+                             SampleHiZ(view, hiz, mip, mipSize, texelMax)));
+    return minDepth > maxDepth;
+}
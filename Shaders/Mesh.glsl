@@ -0,0 +1,60 @@
+// Sections of a mesh blob, see Source/Renderer/MeshBuilder.h.
+// Include after enabling GL_EXT_buffer_reference.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// Meshlets culled by one task shader workgroup
+#define MESHLETS_PER_TASK 32
+
+// MeshVertexLayout, read through device addresses by the mesh shader
+struct MeshVertex
+{
+    float position[3];
+    uint normal; // octahedral, two snorm16
+    uint uv;     // two halfs
+};
+
+struct Meshlet
+{
+    vec4 boundingSphere;
+    vec3 coneApex;
+    float coneCutoff;
+    vec3 coneAxis;
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+    uint padding;
+};
+
+layout(buffer_reference, std430) readonly buffer MeshVertexBuffer { MeshVertex vertices[]; };
+layout(buffer_reference, std430) readonly buffer MeshletBuffer { Meshlet meshlets[]; };
+layout(buffer_reference, std430) readonly buffer MeshletVertexBuffer { uint meshletVertices[]; };
+// Three 8-bit indices into the meshlet's vertices per triangle
+layout(buffer_reference, std430) readonly buffer MeshletTriangleBuffer { uint meshletTriangles[]; };
+
+// Passed from the task shader to the mesh shader workgroups it launches
+struct MeshletPayload
+{
+    uint meshletIndices[MESHLETS_PER_TASK];
+};
+
+vec3 GetPosition(MeshVertex vertex)
+{
+    return vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+// Unfolds the lower hemisphere over the octahedron's diagonals, see VertexOctahedralNormal in Source/RHI/VertexLayout.h
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec3 DecodeOctahedral(uint packed)
+{
+    return DecodeOctahedral(unpackSnorm2x16(packed));
+}
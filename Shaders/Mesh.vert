@@ -0,0 +1,28 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+// Vertex shader of the indirect draw path for mesh blobs, when mesh shaders are unavailable.
+// Outputs match Shaders/Meshlet.mesh, so both paths share the fragment shader.
+
+#include "Culling.glsl"
+#include "Mesh.glsl"
+
+// MeshVertexLayout through the fixed-function vertex input
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(push_constant) uniform PushConstants
+{
+    CullViewBuffer view;
+};
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec2 outUV;
+
+void main()
+{
+    gl_Position = view.viewProj * vec4(inPosition, 1.0);
+    outNormal = DecodeOctahedral(inNormal);
+    outUV = inUV;
+}
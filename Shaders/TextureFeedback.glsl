@@ -0,0 +1,22 @@
+// Streaming feedback, see Source/Renderer/TextureStreaming.h.
+// The buffer holds the finest mip sampled per texture, followed by the sampled pixel count per texture.
+// Include after enabling GL_EXT_buffer_reference.
+
+layout(buffer_reference, std430) buffer TextureFeedbackBuffer { uint data[]; };
+
+// Only one pixel of every 8x8 tile writes, which keeps atomics off the hot path.
+// Coverage is therefore counted in 8x8 tiles.
+void WriteTextureFeedback(TextureFeedbackBuffer feedback, uint maxTextureCount, uint textureID, vec2 uv, vec2 textureSize)
+{
+    // Derivatives are undefined in non-uniform control flow, take them before the early out
+    vec2 dx = dFdx(uv * textureSize);
+    vec2 dy = dFdy(uv * textureSize);
+    if (((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 7) != 0)
+    {
+        return;
+    }
+
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+    atomicMin(feedback.data[textureID], uint(lod));
+    atomicAdd(feedback.data[maxTextureCount + textureID], 1);
+}
@@ -0,0 +1,166 @@
+#include "AssetPack.h"
+#include "Log.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace asset
+{
+static bool MapFile(AssetPack* pack, const char* path)
+{
+#ifdef _WIN32
+    pack->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (pack->file == INVALID_HANDLE_VALUE)
+    {
+        pack->file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(pack->file, &size);
+    pack->size = size.QuadPart;
+    pack->mapping = pack->size != 0 ? CreateFileMappingA(pack->file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    if (pack->mapping == nullptr)
+    {
+        return false;
+    }
+
+    pack->data = static_cast<const uint8_t*>(MapViewOfFile(pack->mapping, FILE_MAP_READ, 0, 0, 0));
+    return pack->data != nullptr;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st = {};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file referenced
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    pack->data = static_cast<const uint8_t*>(data);
+    pack->size = st.st_size;
+    return true;
+#endif
+}
+
+static void UnmapFile(AssetPack* pack)
+{
+#ifdef _WIN32
+    if (pack->data != nullptr)
+    {
+        UnmapViewOfFile(pack->data);
+    }
+    if (pack->mapping != nullptr)
+    {
+        CloseHandle(pack->mapping);
+    }
+    if (pack->file != nullptr)
+    {
+        CloseHandle(pack->file);
+    }
+#else
+    if (pack->data != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(pack->data), pack->size);
+    }
+#endif
+}
+
+uint64_t HashAssetName(std::string_view name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+AssetPack* OpenAssetPack(const char* path)
+{
+    AssetPack* pack = new AssetPack();
+    if (!MapFile(pack, path))
+    {
+        LOGE("Failed to map asset pack %s.\n", path);
+        UnmapFile(pack);
+        delete pack;
+        return nullptr;
+    }
+
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(pack->data);
+    bool valid = pack->size >= sizeof(PackHeader) &&
+                 header->magic == ASSET_PACK_MAGIC &&
+                 header->version == ASSET_PACK_VERSION &&
+                 header->tocOffset % alignof(AssetEntry) == 0 &&
+                 header->tocOffset <= pack->size &&
+                 header->entryCount <= (pack->size - header->tocOffset) / sizeof(AssetEntry);
+    if (valid)
+    {
+        pack->header = header;
+        pack->entries = reinterpret_cast<const AssetEntry*>(pack->data + header->tocOffset);
+        for (uint32_t i = 0; i < header->entryCount && valid; ++i)
+        {
+            const AssetEntry& entry = pack->entries[i];
+            valid = entry.offset <= pack->size && entry.size <= pack->size - entry.offset;
+        }
+    }
+
+    if (!valid)
+    {
+        LOGE("Invalid asset pack %s.\n", path);
+        UnmapFile(pack);
+        delete pack;
+        return nullptr;
+    }
+    return pack;
+}
+
+void CloseAssetPack(AssetPack* pack)
+{
+    if (pack == nullptr)
+    {
+        return;
+    }
+
+    UnmapFile(pack);
+    delete pack;
+}
+
+const AssetEntry* FindAsset(const AssetPack* pack, uint64_t nameHash)
+{
+    const AssetEntry* begin = pack->entries;
+    const AssetEntry* end = pack->entries + pack->header->entryCount;
+    const AssetEntry* entry = std::lower_bound(begin, end, nameHash,
+                                               [](const AssetEntry& entry, uint64_t hash) { return entry.nameHash < hash; });
+    return entry != end && entry->nameHash == nameHash ? entry : nullptr;
+}
+
+const AssetEntry* FindAsset(const AssetPack* pack, std::string_view name)
+{
+    return FindAsset(pack, HashAssetName(name));
+}
+
+std::span<const uint8_t> GetAssetData(const AssetPack* pack, const AssetEntry* entry)
+{
+    return std::span(pack->data + entry->offset, entry->size);
+}
+} // namespace asset
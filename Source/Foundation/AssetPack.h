@@ -0,0 +1,83 @@
+#pragma once
+
+#include <span>
+#include <stdint.h>
+#include <string_view>
+
+#define ASSET_PACK_MAGIC 0x4B415042 // "BPAK"
+#define ASSET_PACK_VERSION 2
+// Every blob starts on this boundary, a multiple of any texel block and of optimalBufferCopyOffsetAlignment in practice
+#define ASSET_BLOB_ALIGNMENT 256
+// Mips of a texture blob follow each other from the largest, each starting on this boundary
+#define ASSET_MIP_ALIGNMENT 16
+
+namespace asset
+{
+enum AssetType : uint32_t
+{
+    ASSET_TYPE_RAW = 0,
+    // Vertex and index data, uploaded as is into one buffer.
+    // Meshes imported by the pack tool start with a renderer::MeshHeader.
+    ASSET_TYPE_MESH = 1,
+    ASSET_TYPE_TEXTURE = 2,
+    ASSET_TYPE_SHADER = 3
+};
+
+enum AssetFlags : uint32_t
+{
+    // Texture blob is an LZ compressed RGBA8 mip chain, transcoded to a block compressed format on load
+    ASSET_FLAG_SUPERCOMPRESSED = 1 << 0,
+    // Every texel has full alpha, so the transcode may drop alpha
+    ASSET_FLAG_OPAQUE = 1 << 1
+};
+
+// File layout: header, blobs, then the table of contents at tocOffset.
+// Everything is read in place from the mapping, nothing is parsed or copied at open.
+struct PackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t padding;
+    uint64_t tocOffset;
+};
+
+// Sorted by nameHash, so lookups are a binary search
+struct AssetEntry
+{
+    uint64_t nameHash;
+    uint64_t offset;
+    uint64_t size;
+    AssetType type;
+    // Textures only, format is a VkFormat
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t flags;
+};
+
+struct AssetPack
+{
+    const uint8_t* data;
+    uint64_t size;
+    const PackHeader* header;
+    const AssetEntry* entries;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+};
+
+uint64_t HashAssetName(std::string_view name);
+
+// Maps the whole file read-only, returns null if it is missing or not a valid pack.
+AssetPack* OpenAssetPack(const char* path);
+// Unmaps the file, spans returned by GetAssetData are invalid afterwards.
+void CloseAssetPack(AssetPack* pack);
+
+const AssetEntry* FindAsset(const AssetPack* pack, uint64_t nameHash);
+const AssetEntry* FindAsset(const AssetPack* pack, std::string_view name);
+// Points into the mapping, pages are read from disk on first touch.
+std::span<const uint8_t> GetAssetData(const AssetPack* pack, const AssetEntry* entry);
+} // namespace asset
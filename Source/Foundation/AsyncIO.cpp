@@ -0,0 +1,442 @@
+#include "AsyncIO.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace asyncio
+{
+struct File
+{
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    uint64_t size;
+};
+
+struct ReadRequest
+{
+    File* file;
+    uint64_t offset;
+    uint64_t size;
+    uint8_t* dst;
+    uint64_t userData;
+};
+
+#ifdef __linux__
+// Raw syscall interface, liburing is not a dependency
+struct IoUring
+{
+    int fd = -1;
+
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    uint32_t* sqHead = nullptr;
+    uint32_t* sqTail = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t* sqArray = nullptr;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    uint32_t* cqHead = nullptr;
+    uint32_t* cqTail = nullptr;
+    uint32_t cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+#endif
+
+struct AsyncIO
+{
+    bool useRing = false;
+    uint32_t queueDepth = 0;
+    std::deque<ReadRequest> queued;
+
+#ifdef __linux__
+    IoUring ring;
+    // Indexed by the user_data of the submission
+    std::vector<ReadRequest> slots;
+    std::vector<iovec> iovecs;
+    std::vector<uint32_t> freeSlots;
+#endif
+
+    // pread fallback, reads run as jobs and push their completion here
+    jobsystem::Counter counter;
+    std::mutex lock;
+    std::vector<ReadCompletion> completed;
+    uint32_t pendingCount = 0;
+} s_io;
+
+static bool ReadSync(File* file, uint64_t offset, uint64_t size, uint8_t* dst)
+{
+    while (size > 0)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = static_cast<DWORD>(std::min<uint64_t>(size, 1u << 30));
+        DWORD read = 0;
+        if (!ReadFile(file->handle, dst, chunk, &read, &overlapped) || read == 0)
+        {
+            return false;
+        }
+#else
+        ssize_t read = pread(file->fd, dst, size, offset);
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read <= 0)
+        {
+            return false;
+        }
+#endif
+        offset += read;
+        size -= read;
+        dst += read;
+    }
+    return true;
+}
+
+#ifdef __linux__
+template <typename T>
+static T* GetRingField(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+}
+
+static void DestroyRing(IoUring& ring)
+{
+    if (ring.sqes != MAP_FAILED)
+    {
+        munmap(ring.sqes, ring.sqesSize);
+    }
+    if (ring.cqRing != MAP_FAILED && ring.cqRing != ring.sqRing)
+    {
+        munmap(ring.cqRing, ring.cqRingSize);
+    }
+    if (ring.sqRing != MAP_FAILED)
+    {
+        munmap(ring.sqRing, ring.sqRingSize);
+    }
+    if (ring.fd >= 0)
+    {
+        close(ring.fd);
+    }
+    ring = {};
+}
+
+static bool CreateRing(IoUring& ring, uint32_t entries)
+{
+    io_uring_params params = {};
+    ring.fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring.fd < 0)
+    {
+        // Old kernels, seccomp filters and kernel.io_uring_disabled all end up here
+        ring.fd = -1;
+        return false;
+    }
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        ring.sqRingSize = std::max(ring.sqRingSize, ring.cqRingSize);
+    }
+
+    ring.sqRing = mmap(nullptr, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sqRing == MAP_FAILED)
+    {
+        DestroyRing(ring);
+        return false;
+    }
+
+    ring.cqRing = singleMmap ? ring.sqRing : mmap(nullptr, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring.sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES));
+    if (ring.cqRing == MAP_FAILED || ring.sqes == MAP_FAILED)
+    {
+        DestroyRing(ring);
+        return false;
+    }
+
+    ring.sqHead = GetRingField<uint32_t>(ring.sqRing, params.sq_off.head);
+    ring.sqTail = GetRingField<uint32_t>(ring.sqRing, params.sq_off.tail);
+    ring.sqMask = *GetRingField<uint32_t>(ring.sqRing, params.sq_off.ring_mask);
+    ring.sqArray = GetRingField<uint32_t>(ring.sqRing, params.sq_off.array);
+    ring.cqHead = GetRingField<uint32_t>(ring.cqRing, params.cq_off.head);
+    ring.cqTail = GetRingField<uint32_t>(ring.cqRing, params.cq_off.tail);
+    ring.cqMask = *GetRingField<uint32_t>(ring.cqRing, params.cq_off.ring_mask);
+    ring.cqes = GetRingField<io_uring_cqe>(ring.cqRing, params.cq_off.cqes);
+    return true;
+}
+
+// Fills submission entries for queued reads while slots are free and enters them with one syscall
+static void SubmitQueued()
+{
+    IoUring& ring = s_io.ring;
+    uint32_t tail = *ring.sqTail;
+    uint32_t submitCount = 0;
+    while (!s_io.queued.empty() && !s_io.freeSlots.empty())
+    {
+        uint32_t slot = s_io.freeSlots.back();
+        s_io.freeSlots.pop_back();
+        ReadRequest& request = s_io.slots[slot];
+        request = s_io.queued.front();
+        s_io.queued.pop_front();
+
+        // Reads beyond what one call can return complete short and are resubmitted
+        s_io.iovecs[slot].iov_base = request.dst;
+        s_io.iovecs[slot].iov_len = std::min<uint64_t>(request.size, 1u << 30);
+
+        uint32_t index = tail & ring.sqMask;
+        io_uring_sqe* sqe = &ring.sqes[index];
+        *sqe = {};
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = request.file->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&s_io.iovecs[slot]);
+        sqe->len = 1;
+        sqe->off = request.offset;
+        sqe->user_data = slot;
+        ring.sqArray[index] = index;
+        tail++;
+        submitCount++;
+    }
+
+    if (submitCount == 0)
+    {
+        return;
+    }
+
+    // The kernel must see the entries before the new tail
+    std::atomic_ref<uint32_t>(*ring.sqTail).store(tail, std::memory_order_release);
+    while (submitCount > 0)
+    {
+        int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ring.fd, submitCount, 0, 0, nullptr, 0));
+        if (submitted < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        {
+            continue;
+        }
+        if (submitted <= 0)
+        {
+            // Entries left in the ring go out with the next enter
+            LOGE("io_uring_enter failed with %d.\n", errno);
+            break;
+        }
+        submitCount -= submitted;
+    }
+}
+
+static uint32_t PollRing(std::span<ReadCompletion> completions)
+{
+    IoUring& ring = s_io.ring;
+    uint32_t head = *ring.cqHead;
+    uint32_t tail = std::atomic_ref<uint32_t>(*ring.cqTail).load(std::memory_order_acquire);
+    uint32_t count = 0;
+    for (; head != tail && count < completions.size(); ++head)
+    {
+        const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+        uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+        ReadRequest request = s_io.slots[slot];
+        s_io.freeSlots.push_back(slot);
+
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+        {
+            s_io.queued.push_front(request);
+            continue;
+        }
+        if (cqe.res > 0 && static_cast<uint64_t>(cqe.res) < request.size)
+        {
+            // Short read, continue where it stopped ahead of everything else
+            request.offset += cqe.res;
+            request.size -= cqe.res;
+            request.dst += cqe.res;
+            s_io.queued.push_front(request);
+            continue;
+        }
+
+        completions[count++] = {request.userData, static_cast<uint64_t>(cqe.res) == request.size};
+    }
+    std::atomic_ref<uint32_t>(*ring.cqHead).store(head, std::memory_order_release);
+
+    SubmitQueued();
+    return count;
+}
+#endif
+
+void Initialize(uint32_t queueDepth)
+{
+    s_io.queueDepth = queueDepth;
+#ifdef __linux__
+    s_io.useRing = CreateRing(s_io.ring, queueDepth);
+    if (s_io.useRing)
+    {
+        s_io.slots.resize(queueDepth);
+        s_io.iovecs.resize(queueDepth);
+        for (uint32_t i = queueDepth; i > 0; --i)
+        {
+            s_io.freeSlots.push_back(i - 1);
+        }
+    }
+#endif
+    LOGI("Async IO: %s\n", s_io.useRing ? "io_uring" : "pread");
+}
+
+void Shutdown()
+{
+    s_io.queued.clear();
+#ifdef __linux__
+    if (s_io.useRing)
+    {
+        // Reads in flight still target caller memory, wait them out
+        ReadCompletion completions[64];
+        while (s_io.freeSlots.size() < s_io.queueDepth)
+        {
+            if (PollRing(completions) == 0)
+            {
+                syscall(__NR_io_uring_enter, s_io.ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            }
+        }
+        DestroyRing(s_io.ring);
+        s_io.slots.clear();
+        s_io.iovecs.clear();
+        s_io.freeSlots.clear();
+    }
+#endif
+    jobsystem::Wait(s_io.counter);
+    s_io.completed.clear();
+    s_io.pendingCount = 0;
+    s_io.useRing = false;
+}
+
+bool IsUsingIoUring()
+{
+    return s_io.useRing;
+}
+
+File* OpenFile(const char* path)
+{
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(handle, &size);
+    return new File{handle, static_cast<uint64_t>(size.QuadPart)};
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st = {};
+    fstat(fd, &st);
+    return new File{fd, static_cast<uint64_t>(st.st_size)};
+#endif
+}
+
+void CloseFile(File* file)
+{
+    if (file == nullptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    CloseHandle(file->handle);
+#else
+    close(file->fd);
+#endif
+    delete file;
+}
+
+uint64_t GetFileSize(const File* file)
+{
+    return file->size;
+}
+
+void Read(File* file, uint64_t offset, uint64_t size, void* dst, uint64_t userData)
+{
+    ReadRequest request = {file, offset, size, static_cast<uint8_t*>(dst), userData};
+    s_io.pendingCount++;
+
+#ifdef __linux__
+    if (s_io.useRing)
+    {
+        s_io.queued.push_back(request);
+        SubmitQueued();
+        return;
+    }
+#endif
+
+    if (jobsystem::GetThreadCount() <= 1)
+    {
+        // No worker would pick the job up before the next wait
+        bool success = ReadSync(request.file, request.offset, request.size, request.dst);
+        std::lock_guard<std::mutex> lock(s_io.lock);
+        s_io.completed.push_back({request.userData, success});
+        return;
+    }
+
+    jobsystem::Execute(s_io.counter, [request](jobsystem::JobArgs) {
+        bool success = ReadSync(request.file, request.offset, request.size, request.dst);
+        std::lock_guard<std::mutex> lock(s_io.lock);
+        s_io.completed.push_back({request.userData, success});
+    });
+}
+
+uint32_t PollReads(std::span<ReadCompletion> completions)
+{
+    uint32_t count = 0;
+#ifdef __linux__
+    if (s_io.useRing)
+    {
+        count = PollRing(completions);
+        s_io.pendingCount -= count;
+        return count;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(s_io.lock);
+    count = static_cast<uint32_t>(std::min(completions.size(), s_io.completed.size()));
+    std::copy(s_io.completed.begin(), s_io.completed.begin() + count, completions.begin());
+    s_io.completed.erase(s_io.completed.begin(), s_io.completed.begin() + count);
+    s_io.pendingCount -= count;
+    return count;
+}
+
+uint32_t GetPendingReadCount()
+{
+    return s_io.pendingCount;
+}
+} // namespace asyncio
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <span>
+#include <stdint.h>
+
+namespace asyncio
+{
+struct File;
+
+struct ReadCompletion
+{
+    uint64_t userData;
+    bool success;
+};
+
+// Reads through io_uring on Linux when the kernel allows it, with pread on job system threads otherwise.
+// queueDepth bounds the reads in flight, more are queued and submitted as earlier ones complete.
+void Initialize(uint32_t queueDepth = 256);
+// Waits for every read in flight, queued reads are dropped.
+void Shutdown();
+bool IsUsingIoUring();
+
+File* OpenFile(const char* path);
+// No reads of the file may be in flight.
+void CloseFile(File* file);
+uint64_t GetFileSize(const File* file);
+
+// Reads size bytes at offset into dst, which must stay valid until the completion is polled.
+// Read and PollReads must be called from the same thread.
+void Read(File* file, uint64_t offset, uint64_t size, void* dst, uint64_t userData);
+// Returns the number of completions written, reads that do not fit are returned by the next poll.
+uint32_t PollReads(std::span<ReadCompletion> completions);
+// Reads queued or in flight, including finished ones not polled yet
+uint32_t GetPendingReadCount();
+} // namespace asyncio
@@ -0,0 +1,165 @@
+#include "Compression.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+// The format requires the last match to end this far from the end, the tail is literals
+#define LZ_LAST_LITERALS 5
+#define LZ_HASH_BITS 16
+
+namespace compression
+{
+static uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void WriteLength(std::vector<uint8_t>& dst, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        dst.push_back(255);
+    }
+    dst.push_back(static_cast<uint8_t>(length));
+}
+
+static void WriteSequence(std::vector<uint8_t>& dst, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength - LZ_MIN_MATCH;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+    dst.push_back(token);
+    if (literalCount >= 15)
+    {
+        WriteLength(dst, literalCount - 15);
+    }
+    dst.insert(dst.end(), literals, literals + literalCount);
+
+    dst.push_back(static_cast<uint8_t>(offset));
+    dst.push_back(static_cast<uint8_t>(offset >> 8));
+    if (matchCode >= 15)
+    {
+        WriteLength(dst, matchCode - 15);
+    }
+}
+
+void CompressLZ(std::span<const uint8_t> src, std::vector<uint8_t>& dst)
+{
+    dst.clear();
+    std::vector<uint32_t> table(1u << LZ_HASH_BITS, UINT32_MAX);
+
+    const uint8_t* base = src.data();
+    size_t size = src.size();
+    size_t anchor = 0;
+    size_t pos = 0;
+    // Matches may not start in the last 12 bytes
+    size_t matchLimit = size > 12 ? size - 12 : 0;
+    while (pos < matchLimit)
+    {
+        uint32_t sequence = Read32(base + pos);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(pos);
+
+        if (candidate == UINT32_MAX || pos - candidate > LZ_MAX_OFFSET || Read32(base + candidate) != sequence)
+        {
+            pos++;
+            continue;
+        }
+
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < size - LZ_LAST_LITERALS && base[candidate + length] == base[pos + length])
+        {
+            length++;
+        }
+
+        WriteSequence(dst, base + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    // Last sequence, literals only
+    size_t literalCount = size - anchor;
+    dst.push_back(static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4));
+    if (literalCount >= 15)
+    {
+        WriteLength(dst, literalCount - 15);
+    }
+    dst.insert(dst.end(), base + anchor, base + size);
+}
+
+static bool ReadLength(const uint8_t*& src, const uint8_t* srcEnd, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (src == srcEnd)
+        {
+            return false;
+        }
+        byte = *src++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool DecompressLZ(std::span<const uint8_t> src, std::span<uint8_t> dst)
+{
+    const uint8_t* in = src.data();
+    const uint8_t* inEnd = in + src.size();
+    uint8_t* out = dst.data();
+    uint8_t* outEnd = out + dst.size();
+
+    while (in < inEnd)
+    {
+        uint8_t token = *in++;
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(in, inEnd, literalCount))
+        {
+            return false;
+        }
+        if (literalCount > size_t(inEnd - in) || literalCount > size_t(outEnd - out))
+        {
+            return false;
+        }
+        memcpy(out, in, literalCount);
+        in += literalCount;
+        out += literalCount;
+
+        if (in == inEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, inEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > size_t(out - dst.data()) || matchLength > size_t(outEnd - out))
+        {
+            return false;
+        }
+
+        // Overlapping matches repeat the pattern, copy byte by byte
+        const uint8_t* match = out - offset;
+        for (size_t i = 0; i < matchLength; ++i)
+        {
+            out[i] = match[i];
+        }
+        out += matchLength;
+    }
+    return out == outEnd;
+}
+} // namespace compression
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+namespace compression
+{
+// LZ4 block format: byte aligned, no entropy stage, decodes at memory speed.
+// The compressor is greedy and meant for offline tools.
+void CompressLZ(std::span<const uint8_t> src, std::vector<uint8_t>& dst);
+// dst must be exactly the uncompressed size, returns false on malformed input.
+bool DecompressLZ(std::span<const uint8_t> src, std::span<uint8_t> dst);
+} // namespace compression
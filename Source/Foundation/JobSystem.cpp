@@ -0,0 +1,442 @@
+#include "JobSystem.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Power of two. Capacity of every queue and of the job slots each spawning thread owns.
+#define MAX_JOB_COUNT 4096
+
+namespace jobsystem
+{
+struct Job
+{
+    JobFunction task;
+    Counter* counter = nullptr;
+    uint32_t groupID = 0;
+    uint32_t groupJobOffset = 0;
+    uint32_t groupJobEnd = 0;
+    // Slot bookkeeping, see JobPool
+    struct JobPool* pool = nullptr;
+    uint32_t nextFree = 0;
+};
+
+// Chase-Lev deque. The owning thread pushes and pops at the bottom, other threads steal from the top.
+struct WorkStealingQueue
+{
+    std::atomic<int64_t> top = 0;
+    std::atomic<int64_t> bottom = 0;
+    std::atomic<Job*> jobs[MAX_JOB_COUNT] = {};
+
+    bool Push(Job* job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= MAX_JOB_COUNT)
+        {
+            return false;
+        }
+
+        jobs[b & (MAX_JOB_COUNT - 1)].store(job, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* Pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = jobs[b & (MAX_JOB_COUNT - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // Last job, race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* Steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+
+        Job* job = jobs[t & (MAX_JOB_COUNT - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return job;
+    }
+};
+
+// Bounded MPMC queue (Vyukov) for jobs submitted by threads that own no deque.
+struct InjectionQueue
+{
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        Job* job;
+    };
+
+    Cell cells[MAX_JOB_COUNT];
+    alignas(64) std::atomic<uint64_t> enqueuePos = 0;
+    alignas(64) std::atomic<uint64_t> dequeuePos = 0;
+
+    InjectionQueue()
+    {
+        for (uint64_t i = 0; i < MAX_JOB_COUNT; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(Job* job)
+    {
+        uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = cells[pos & (MAX_JOB_COUNT - 1)];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)pos;
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.job = job;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Job* Pop()
+    {
+        uint64_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = cells[pos & (MAX_JOB_COUNT - 1)];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)sequence - (int64_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    Job* job = cell.job;
+                    cell.sequence.store(pos + MAX_JOB_COUNT, std::memory_order_release);
+                    return job;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+static bool TryRunJob();
+
+// Job slots owned by the spawning thread. Finished jobs push their slot onto a lock-free free list from
+// whichever thread ran them, only the owner pops, so the list is safe from ABA. When every slot is busy
+// the owner runs jobs until one is released.
+struct JobPool
+{
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::unique_ptr<Job[]> jobs;
+    // Slots below this were handed out at least once, the rest were never used
+    uint32_t usedCount = 0;
+    std::atomic<uint32_t> freeHead = EMPTY;
+
+    Job* Allocate()
+    {
+        if (jobs == nullptr)
+        {
+            jobs = std::make_unique<Job[]>(MAX_JOB_COUNT);
+        }
+
+        while (true)
+        {
+            if (usedCount < MAX_JOB_COUNT)
+            {
+                Job* job = &jobs[usedCount++];
+                job->pool = this;
+                return job;
+            }
+
+            uint32_t head = freeHead.load(std::memory_order_acquire);
+            while (head != EMPTY && !freeHead.compare_exchange_weak(head, jobs[head].nextFree, std::memory_order_acquire))
+            {
+            }
+            if (head != EMPTY)
+            {
+                return &jobs[head];
+            }
+
+            if (!TryRunJob())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void Free(Job* job)
+    {
+        uint32_t index = static_cast<uint32_t>(job - jobs.get());
+        uint32_t head = freeHead.load(std::memory_order_relaxed);
+        do
+        {
+            job->nextFree = head;
+        } while (!freeHead.compare_exchange_weak(head, index, std::memory_order_release, std::memory_order_relaxed));
+    }
+};
+
+struct JobSystem
+{
+    uint32_t threadCount = 0;
+    std::atomic<bool> running = false;
+    std::atomic<uint32_t> signal = 0;
+
+    std::unique_ptr<WorkStealingQueue[]> queues;
+    std::unique_ptr<InjectionQueue> injectionQueue;
+    std::vector<std::thread> workers;
+} s_jobSystem;
+
+thread_local uint32_t t_threadIndex = UINT32_MAX;
+thread_local uint32_t t_stealSeed = 0;
+thread_local JobPool t_jobPool;
+
+static void RunJob(Job* job)
+{
+    JobArgs args;
+    args.groupID = job->groupID;
+    for (uint32_t i = job->groupJobOffset; i < job->groupJobEnd; ++i)
+    {
+        args.jobIndex = i;
+        args.groupIndex = i - job->groupJobOffset;
+        job->task(args);
+    }
+
+    // The slot may be reused as soon as it is released, so nothing may touch the job afterwards
+    Counter* counter = job->counter;
+    job->task = nullptr;
+    job->pool->Free(job);
+    counter->value.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+static Job* FindJob()
+{
+    uint32_t threadIndex = t_threadIndex;
+    Job* job = nullptr;
+    if (threadIndex != UINT32_MAX)
+    {
+        job = s_jobSystem.queues[threadIndex].Pop();
+    }
+
+    if (job == nullptr)
+    {
+        job = s_jobSystem.injectionQueue->Pop();
+    }
+
+    if (job == nullptr)
+    {
+        // Start stealing at a pseudo random victim so thieves spread out
+        t_stealSeed = t_stealSeed * 1664525u + 1013904223u;
+        uint32_t start = t_stealSeed % s_jobSystem.threadCount;
+        for (uint32_t i = 0; i < s_jobSystem.threadCount && job == nullptr; ++i)
+        {
+            uint32_t victim = (start + i) % s_jobSystem.threadCount;
+            if (victim != threadIndex)
+            {
+                job = s_jobSystem.queues[victim].Steal();
+            }
+        }
+    }
+    return job;
+}
+
+static bool TryRunJob()
+{
+    Job* job = FindJob();
+    if (job == nullptr)
+    {
+        return false;
+    }
+
+    RunJob(job);
+    return true;
+}
+
+static void Submit(Job* job)
+{
+    bool queued = t_threadIndex != UINT32_MAX
+                      ? s_jobSystem.queues[t_threadIndex].Push(job)
+                      : s_jobSystem.injectionQueue->Push(job);
+    if (!queued)
+    {
+        // Queues are saturated, running inline keeps forward progress
+        RunJob(job);
+        return;
+    }
+
+    s_jobSystem.signal.fetch_add(1, std::memory_order_release);
+    s_jobSystem.signal.notify_one();
+}
+
+static void WorkerLoop(uint32_t threadIndex)
+{
+    t_threadIndex = threadIndex;
+    t_stealSeed = threadIndex;
+
+    while (s_jobSystem.running.load(std::memory_order_acquire))
+    {
+        uint32_t signal = s_jobSystem.signal.load(std::memory_order_acquire);
+        if (!TryRunJob())
+        {
+            s_jobSystem.signal.wait(signal, std::memory_order_acquire);
+        }
+    }
+}
+
+void Initialize(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    s_jobSystem.threadCount = threadCount;
+    s_jobSystem.queues = std::make_unique<WorkStealingQueue[]>(threadCount);
+    s_jobSystem.injectionQueue = std::make_unique<InjectionQueue>();
+    s_jobSystem.running.store(true, std::memory_order_release);
+
+    // The initializing thread owns queue 0 and helps out whenever it waits
+    t_threadIndex = 0;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        s_jobSystem.workers.emplace_back(WorkerLoop, i);
+    }
+
+    LOGI("Job system: %u threads\n", threadCount);
+}
+
+void Shutdown()
+{
+    s_jobSystem.running.store(false, std::memory_order_release);
+    s_jobSystem.signal.fetch_add(1, std::memory_order_release);
+    s_jobSystem.signal.notify_all();
+
+    for (std::thread& worker : s_jobSystem.workers)
+    {
+        worker.join();
+    }
+    s_jobSystem.workers.clear();
+
+    // Drain whatever is left so no counter is left waiting
+    while (TryRunJob())
+    {
+    }
+
+    s_jobSystem.queues.reset();
+    s_jobSystem.injectionQueue.reset();
+    s_jobSystem.threadCount = 0;
+    t_threadIndex = UINT32_MAX;
+}
+
+uint32_t GetThreadCount()
+{
+    return s_jobSystem.threadCount;
+}
+
+uint32_t GetThreadIndex()
+{
+    return t_threadIndex;
+}
+
+void Execute(Counter& counter, JobFunction&& task)
+{
+    assert(s_jobSystem.running.load(std::memory_order_relaxed));
+    counter.value.fetch_add(1, std::memory_order_relaxed);
+
+    Job* job = t_jobPool.Allocate();
+    job->task = std::move(task);
+    job->counter = &counter;
+    job->groupID = 0;
+    job->groupJobOffset = 0;
+    job->groupJobEnd = 1;
+    Submit(job);
+}
+
+void Dispatch(Counter& counter, uint32_t jobCount, uint32_t groupSize, const JobFunction& task)
+{
+    assert(s_jobSystem.running.load(std::memory_order_relaxed));
+    if (jobCount == 0 || groupSize == 0)
+    {
+        return;
+    }
+
+    uint32_t groupCount = (jobCount + groupSize - 1) / groupSize;
+    counter.value.fetch_add(groupCount, std::memory_order_relaxed);
+
+    for (uint32_t groupID = 0; groupID < groupCount; ++groupID)
+    {
+        Job* job = t_jobPool.Allocate();
+        job->task = task;
+        job->counter = &counter;
+        job->groupID = groupID;
+        job->groupJobOffset = groupID * groupSize;
+        job->groupJobEnd = std::min(job->groupJobOffset + groupSize, jobCount);
+        Submit(job);
+    }
+}
+
+bool IsBusy(const Counter& counter)
+{
+    return counter.value.load(std::memory_order_acquire) > 0;
+}
+
+void Wait(const Counter& counter)
+{
+    while (IsBusy(counter))
+    {
+        if (!TryRunJob())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+} // namespace jobsystem
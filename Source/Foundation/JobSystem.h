@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+namespace jobsystem
+{
+struct JobArgs
+{
+    uint32_t jobIndex;   // index of the job within the whole dispatch
+    uint32_t groupID;    // index of the group this job belongs to
+    uint32_t groupIndex; // index of the job within its group
+};
+
+using JobFunction = std::function<void(JobArgs)>;
+
+// Tracks outstanding jobs. A job may wait on the counter of the jobs it depends on.
+struct Counter
+{
+    std::atomic<uint32_t> value = 0;
+};
+
+// Spawns one worker per remaining core, threadCount == 0 uses every core.
+void Initialize(uint32_t threadCount = 0);
+void Shutdown();
+
+uint32_t GetThreadCount();
+// Stable index of the calling thread in [0, GetThreadCount()), UINT32_MAX for threads the job system does not own.
+uint32_t GetThreadIndex();
+
+void Execute(Counter& counter, JobFunction&& task);
+// Splits jobCount invocations into groups of groupSize, every group runs as a single job.
+void Dispatch(Counter& counter, uint32_t jobCount, uint32_t groupSize, const JobFunction& task);
+
+bool IsBusy(const Counter& counter);
+// Runs other jobs on the calling thread until the counter reaches zero.
+void Wait(const Counter& counter);
+} // namespace jobsystem
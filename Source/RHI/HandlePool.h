@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_GENERATION_BITS 12
+#define HANDLE_POOL_CHUNK_SIZE 1024
+#define HANDLE_POOL_MAX_CHUNKS ((1u << HANDLE_INDEX_BITS) / HANDLE_POOL_CHUNK_SIZE)
+// Freed slots wait until this many are free before one is reused
+#define HANDLE_POOL_QUARANTINE 1024
+
+namespace rhi
+{
+// 32 bits: slot index in the low bits, generation in the high bits. Zero is never a live handle.
+template <typename T>
+struct Handle
+{
+    uint32_t value = 0;
+
+    uint32_t GetIndex() const { return value & ((1u << HANDLE_INDEX_BITS) - 1); }
+    uint32_t GetGeneration() const { return value >> HANDLE_INDEX_BITS; }
+    explicit operator bool() const { return value != 0; }
+    bool operator==(const Handle&) const = default;
+};
+
+// Typed generational slots with O(1) allocate and free through a free list.
+// Items live in fixed-size chunks that are never released, so pointers stay valid while the pool grows,
+// and a stale pointer still reads a slot the pool can check instead of freed memory.
+// The free list is a FIFO behind a quarantine: a slot is reused only after HANDLE_POOL_QUARANTINE other frees,
+// so a stale pointer keeps reading its dead id for that long instead of the id of the next item in its slot.
+// Slot states are stored apart from the items: validating and iterating stream through one dense array per chunk.
+// Allocate and Free serialize on a lock, lookups take none. A generation repeats after 4096 reuses of its slot.
+template <typename T>
+struct HandlePool
+{
+    static constexpr uint32_t ALIVE_BIT = 1u << 31;
+    static constexpr uint32_t GENERATION_MASK = (1u << HANDLE_GENERATION_BITS) - 1;
+
+    struct Chunk
+    {
+        // Current generation of each slot, with ALIVE_BIT while allocated
+        uint32_t states[HANDLE_POOL_CHUNK_SIZE] = {};
+        T items[HANDLE_POOL_CHUNK_SIZE] = {};
+    };
+
+    std::mutex lock;
+    std::unique_ptr<Chunk> chunks[HANDLE_POOL_MAX_CHUNKS];
+    // Published after its chunk is created, for lookups racing a growing Allocate
+    std::atomic<uint32_t> slotCount = 0;
+    // Oldest first
+    std::deque<uint32_t> freeSlots;
+
+    // The item is value initialized
+    Handle<T> Allocate()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uint32_t index = 0;
+        if (freeSlots.size() > HANDLE_POOL_QUARANTINE)
+        {
+            index = freeSlots.front();
+            freeSlots.pop_front();
+        }
+        else
+        {
+            index = slotCount.load(std::memory_order_relaxed);
+            assert(index < (1u << HANDLE_INDEX_BITS) && "Handle pool exhausted");
+            if (index % HANDLE_POOL_CHUNK_SIZE == 0)
+            {
+                chunks[index / HANDLE_POOL_CHUNK_SIZE] = std::make_unique<Chunk>();
+            }
+            slotCount.store(index + 1, std::memory_order_release);
+        }
+
+        Chunk& chunk = *chunks[index / HANDLE_POOL_CHUNK_SIZE];
+        uint32_t slot = index % HANDLE_POOL_CHUNK_SIZE;
+        // Generations start at 1 and skip 0 on wrap, so no live handle is zero
+        uint32_t generation = chunk.states[slot] & GENERATION_MASK;
+        if (generation == 0)
+        {
+            generation = 1;
+        }
+        chunk.states[slot] = generation | ALIVE_BIT;
+        chunk.items[slot] = {};
+        return {generation << HANDLE_INDEX_BITS | index};
+    }
+
+    void Free(Handle<T> handle)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        assert(IsAlive(handle) && "Freed a stale handle");
+        uint32_t index = handle.GetIndex();
+        uint32_t& state = chunks[index / HANDLE_POOL_CHUNK_SIZE]->states[index % HANDLE_POOL_CHUNK_SIZE];
+        state = (handle.GetGeneration() + 1) & GENERATION_MASK;
+        freeSlots.push_back(index);
+    }
+
+    bool IsAlive(Handle<T> handle) const
+    {
+        uint32_t index = handle.GetIndex();
+        if (handle.value == 0 || index >= slotCount.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        return chunks[index / HANDLE_POOL_CHUNK_SIZE]->states[index % HANDLE_POOL_CHUNK_SIZE] == (handle.GetGeneration() | ALIVE_BIT);
+    }
+
+    // Null for stale handles
+    T* Get(Handle<T> handle)
+    {
+        if (!IsAlive(handle))
+        {
+            return nullptr;
+        }
+        uint32_t index = handle.GetIndex();
+        return &chunks[index / HANDLE_POOL_CHUNK_SIZE]->items[index % HANDLE_POOL_CHUNK_SIZE];
+    }
+
+    // Visits live items in slot order, must not run concurrently with Allocate or Free
+    template <typename F>
+    void ForEach(F&& visit)
+    {
+        uint32_t slotCount = this->slotCount.load(std::memory_order_acquire);
+        for (uint32_t base = 0; base < slotCount; base += HANDLE_POOL_CHUNK_SIZE)
+        {
+            Chunk& chunk = *chunks[base / HANDLE_POOL_CHUNK_SIZE];
+            uint32_t count = std::min<uint32_t>(slotCount - base, HANDLE_POOL_CHUNK_SIZE);
+            for (uint32_t slot = 0; slot < count; ++slot)
+            {
+                if (chunk.states[slot] & ALIVE_BIT)
+                {
+                    visit(Handle<T>{(chunk.states[slot] & GENERATION_MASK) << HANDLE_INDEX_BITS | (base + slot)}, chunk.items[slot]);
+                }
+            }
+        }
+    }
+};
+} // namespace rhi
@@ -4,10 +4,24 @@
 #include <volk.h>
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
+#include <spirv_reflect.h>
+
+#include "Foundation/JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #define MAX_QUEUE_COUNT 2
-#define MAX_FRAMES_IN_FLIGHT 3
 #define MAX_CMD_BUFFER_COUNT 8
+#define MAX_DESCRIPTOR_POOL_SETS 1024
+#define MIN_PIPELINE_MAP_CAPACITY 256
+// Device-local host-visible heaps up to the legacy BAR window are too small to place resources in freely
+#define LEGACY_BAR_HEAP_SIZE (256ull << 20)
+#define PIPELINE_STATE_LIST_MAGIC 0x4C535042 // "BPSL"
+#define PIPELINE_STATE_LIST_VERSION 3
 
 namespace rhi
 {
@@ -18,6 +32,15 @@ struct CommandPool
     CommandBuffer commandBuffers[MAX_CMD_BUFFER_COUNT] = {};
 };
 
+// Linear allocator over descriptor pools, owned by one thread for one frame
+struct DescriptorAllocator
+{
+    uint32_t poolIdx = 0;
+    // Sets allocated from pools[poolIdx] this frame
+    uint32_t poolSetCount = 0;
+    std::vector<VkDescriptorPool> pools;
+};
+
 struct Frame
 {
     VkFence fence = VK_NULL_HANDLE;
@@ -25,6 +48,9 @@ struct Frame
     VkSemaphore acquireSemaphore = VK_NULL_HANDLE;
     VkSemaphore releaseSemaphore = VK_NULL_HANDLE;
     CommandPool pools[MAX_QUEUE_COUNT] = {};
+    // One per job system thread, the last one is shared by every other thread under descriptorLock
+    std::vector<DescriptorAllocator> descriptorAllocators;
+    std::mutex descriptorLock;
 };
 
 struct Context
@@ -35,25 +61,44 @@ struct Context
     VkInstance instance = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkQueue queues[MAX_QUEUE_COUNT] = {};
+    uint32_t queueFamilies[MAX_QUEUE_COUNT] = {};
 
     VkPhysicalDeviceProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
     VkPhysicalDeviceVulkan11Properties properties_1_1 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES};
     VkPhysicalDeviceVulkan12Properties properties_1_2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
     VkPhysicalDeviceVulkan13Properties properties_1_3 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_PROPERTIES};
+    VkPhysicalDeviceVulkan14Properties properties_1_4 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_PROPERTIES};
+    VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR};
     VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR raytracingProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
+    VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT};
 
     VkPhysicalDeviceFeatures2KHR features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR};
     VkPhysicalDeviceVulkan11Features features_1_1 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
     VkPhysicalDeviceVulkan12Features features_1_2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
     VkPhysicalDeviceVulkan13Features features_1_3 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceVulkan14Features features_1_4 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES};
     VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
     VkPhysicalDeviceRayTracingPipelineFeaturesKHR raytracingFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR};
     VkPhysicalDeviceRayQueryFeaturesKHR raytracingQueryFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT};
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT};
 
     VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
 
     VmaAllocator allocator = VK_NULL_HANDLE;
+    MemoryStats memoryStats = {};
+    bool resizableBar = false;
+
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+    // Signaled with frameCount + 1 by every graphics submit, for copy work that must follow earlier frames
+    VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+
+    // Core in 1.4, VK_KHR_push_descriptor before that, null if neither is available
+    PFN_vkCmdPushDescriptorSetWithTemplate cmdPushDescriptorSetWithTemplate = nullptr;
+    uint32_t maxPushDescriptors = 0;
 
     Frame frames[MAX_FRAMES_IN_FLIGHT] = {};
 } s_ctx;
@@ -70,15 +115,375 @@ struct ResourceManager
     std::deque<std::pair<VkDescriptorSetLayout, uint64_t>> destroyerDescriptorSetLayouts;
     std::deque<std::pair<VkDescriptorUpdateTemplate, uint64_t>> destroyerDescriptorUpdateTemplates;
     std::deque<std::pair<VkShaderModule, uint64_t>> destroyerShaderModules;
+    std::deque<std::pair<VkShaderEXT, uint64_t>> destroyerShaderObjects;
     std::deque<std::pair<VkPipelineLayout, uint64_t>> destroyerPipelineLayouts;
     std::deque<std::pair<VkPipeline, uint64_t>> destroyerPipelines;
     std::deque<std::pair<VkQueryPool, uint64_t>> destroyerQueryPools;
     std::deque<std::pair<VkAccelerationStructureKHR, uint64_t>> destroyerAccelerationStructures;
+
+    template <typename T, typename F>
+    static void Drain(std::deque<std::pair<T, uint64_t>>& destroyer, uint64_t frameCount, uint32_t bufferCount, F&& destroy)
+    {
+        while (!destroyer.empty() && destroyer.front().second + bufferCount <= frameCount)
+        {
+            destroy(destroyer.front().first);
+            destroyer.pop_front();
+        }
+    }
+
+    void Update(VkDevice device, VmaAllocator allocator, uint64_t currentFrameCount, uint32_t bufferCount)
+    {
+        frameCount = currentFrameCount;
+
+        Drain(destroyerImages, frameCount, bufferCount, [&](auto& item) { vmaDestroyImage(allocator, item.first, item.second); });
+        Drain(destroyerImageviews, frameCount, bufferCount, [&](auto& item) { vkDestroyImageView(device, item, nullptr); });
+        Drain(destroyerBuffers, frameCount, bufferCount, [&](auto& item) { vmaDestroyBuffer(allocator, item.first, item.second); });
+        Drain(destroyerSamplers, frameCount, bufferCount, [&](auto& item) { vkDestroySampler(device, item, nullptr); });
+        Drain(destroyerDescriptorPools, frameCount, bufferCount, [&](auto& item) { vkDestroyDescriptorPool(device, item, nullptr); });
+        Drain(destroyerDescriptorSetLayouts, frameCount, bufferCount, [&](auto& item) { vkDestroyDescriptorSetLayout(device, item, nullptr); });
+        Drain(destroyerDescriptorUpdateTemplates, frameCount, bufferCount, [&](auto& item) { vkDestroyDescriptorUpdateTemplate(device, item, nullptr); });
+        Drain(destroyerShaderModules, frameCount, bufferCount, [&](auto& item) { vkDestroyShaderModule(device, item, nullptr); });
+        Drain(destroyerShaderObjects, frameCount, bufferCount, [&](auto& item) { vkDestroyShaderEXT(device, item, nullptr); });
+        Drain(destroyerPipelineLayouts, frameCount, bufferCount, [&](auto& item) { vkDestroyPipelineLayout(device, item, nullptr); });
+        Drain(destroyerPipelines, frameCount, bufferCount, [&](auto& item) { vkDestroyPipeline(device, item, nullptr); });
+        Drain(destroyerQueryPools, frameCount, bufferCount, [&](auto& item) { vkDestroyQueryPool(device, item, nullptr); });
+        Drain(destroyerAccelerationStructures, frameCount, bufferCount, [&](auto& item) { vkDestroyAccelerationStructureKHR(device, item, nullptr); });
+    }
 } s_resMgr;
 
+struct PipelineCompileRequest
+{
+    Pipeline* pipeline = nullptr;
+    const Shader* computeShader = nullptr;
+    GraphicsPipelineDesc graphicsDesc = {};
+    std::vector<VkFormat> colorFormats;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    // Relink an already fast-linked pipeline from its libraries with full optimization
+    bool linkTimeOptimization = false;
+    // Enqueue order, breaks priority ties so requests compile first come first served
+    uint64_t sequence = 0;
+};
+
+struct PipelineCompiler
+{
+    std::mutex lock;
+    std::vector<PipelineCompileRequest> pending;
+    uint64_t sequence = 0;
+    jobsystem::Counter counter;
+
+    // Graphics pipeline library parts keyed by the hash of the state they consume
+    std::unordered_map<uint64_t, VkPipeline> libraries;
+    // Optimized links waiting to replace the fast-linked handle
+    std::vector<std::pair<Pipeline*, VkPipeline>> optimized;
+
+    std::atomic<uint64_t> compileCount = 0;
+    std::atomic<uint64_t> compileTimeNs = 0;
+} s_compiler;
+
+struct PipelineStateListHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordCount;
+    // Guards against reading lists written with a different PipelineStateKey
+    uint32_t recordSize;
+};
+
+struct PipelineRecorder
+{
+    std::mutex lock;
+    bool active = false;
+    std::string path;
+    // Record index by state hash, records stay in first use order
+    std::unordered_map<uint64_t, size_t> indices;
+    std::vector<PipelineStateRecord> records;
+} s_recorder;
+
+// Open addressing table, a slot is published by its hash and never changes afterwards
+struct PipelineMapTable
+{
+    struct Slot
+    {
+        std::atomic<uint64_t> hash = 0;
+        PipelineStateKey key = {};
+        Pipeline* pipeline = nullptr;
+    };
+
+    uint32_t capacity = 0;
+    std::unique_ptr<Slot[]> slots;
+};
+
+// Readers probe the current table without locking, inserts serialize on the lock.
+// Growing publishes a new table, the old ones stay alive until Shutdown for readers still probing them.
+struct PipelineMap
+{
+    std::atomic<PipelineMapTable*> table = nullptr;
+    std::mutex lock;
+    uint32_t count = 0;
+    std::vector<std::unique_ptr<PipelineMapTable>> tables;
+    // Created by threads that lost an insert race, destroyed at the start of the next frame
+    std::vector<Pipeline*> discarded;
+
+    std::atomic<uint64_t> hitCount = 0;
+    std::atomic<uint64_t> missCount = 0;
+} s_pipelineMap;
+
+struct Defragmenter
+{
+    bool active = false;
+    bool stopRequested = false;
+    bool passActive = false;
+    uint64_t passFrameCount = 0;
+
+    VmaDefragmentationContext context = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo pass = {};
+
+    // Allocations of buffers destroyed while their move was in flight, freed once the pass ends
+    std::vector<VmaAllocation> destroyedAllocations;
+} s_defrag;
+
+// Regions are freed from the front once the frame they were committed in retires
+struct StagingRegion
+{
+    VkDeviceSize offset;
+    // Ring bytes the region takes, including padding and the skipped end on wrap
+    VkDeviceSize size;
+    // UINT64_MAX while reserved
+    uint64_t frameCount;
+};
+
+struct StagingRing
+{
+    std::mutex lock;
+    Buffer* buffer = nullptr;
+    VkDeviceSize head = 0;
+    VkDeviceSize usedBytes = 0;
+    std::deque<StagingRegion> regions;
+} s_staging;
+
+// Only the current frame's buffer is written, earlier ones are still read by frames in flight
+struct TransientAllocator
+{
+    Buffer* buffers[MAX_FRAMES_IN_FLIGHT] = {};
+    std::atomic<VkDeviceSize> head = 0;
+} s_transient;
+
+// Events are reset from the host once their frame's fence was waited, then handed out again
+struct SplitBarrierPool
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<SplitBarrier>> barriers[MAX_FRAMES_IN_FLIGHT];
+    uint32_t counts[MAX_FRAMES_IN_FLIGHT] = {};
+} s_splitBarriers;
+
+// Semaphores added by producers for the current frame, merged into each queue's single vkQueueSubmit2
+struct SubmitBatch
+{
+    std::vector<VkSemaphoreSubmitInfo> waits;
+    std::vector<VkSemaphoreSubmitInfo> signals;
+};
+
+struct SubmitBatches
+{
+    std::mutex lock;
+    SubmitBatch batches[MAX_QUEUE_COUNT];
+    // The previous policy, kept to measure against, see SetSubmitIdleQueues
+    bool submitIdleQueues = false;
+} s_submit;
+
+// Every Buffer and Texture, destroyed slots are reused through the pools' free lists
+HandlePool<Buffer> s_buffers;
+HandlePool<Texture> s_textures;
+
 static uint32_t GetFrameIndex() { return s_ctx.frameCount % MAX_FRAMES_IN_FLIGHT; }
 static Frame& GetFrame() { return s_ctx.frames[GetFrameIndex()]; }
 
+// Command buffers are begun before they are handed out, the pool reset at frame start discards those never submitted
+static void BeginCmdBuffer(CommandBuffer& cmd)
+{
+    VkCommandBufferBeginInfo cmdBeginInfo = {};
+    cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cmdBeginInfo.pInheritanceInfo = nullptr;
+    VK_ASSERT(vkBeginCommandBuffer(cmd.handle, &cmdBeginInfo));
+}
+
+static uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+    return Hash(&value, sizeof(value), hash);
+}
+
+static VkDescriptorPool CreateDescriptorPool()
+{
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_SAMPLER, MAX_DESCRIPTOR_POOL_SETS},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_DESCRIPTOR_POOL_SETS * 4},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_DESCRIPTOR_POOL_SETS * 4},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_DESCRIPTOR_POOL_SETS},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MAX_DESCRIPTOR_POOL_SETS * 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_DESCRIPTOR_POOL_SETS * 2},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, MAX_DESCRIPTOR_POOL_SETS},
+        {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, MAX_DESCRIPTOR_POOL_SETS},
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = MAX_DESCRIPTOR_POOL_SETS;
+    poolInfo.poolSizeCount = (uint32_t)std::size(poolSizes);
+    poolInfo.pPoolSizes = poolSizes;
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreateDescriptorPool(s_ctx.device, &poolInfo, nullptr, &pool));
+    return pool;
+}
+
+// Returns null when the layout does not fit an empty pool, see CreateDescriptorPool
+static VkDescriptorSet AllocateDescriptorSet(VkDescriptorSetLayout layout)
+{
+    Frame& frame = GetFrame();
+    uint32_t threadIndex = jobsystem::GetThreadIndex();
+    std::unique_lock<std::mutex> lock;
+    if (threadIndex >= frame.descriptorAllocators.size() - 1)
+    {
+        threadIndex = static_cast<uint32_t>(frame.descriptorAllocators.size() - 1);
+        lock = std::unique_lock<std::mutex>(frame.descriptorLock);
+    }
+    DescriptorAllocator& allocator = frame.descriptorAllocators[threadIndex];
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    while (true)
+    {
+        if (allocator.poolIdx == allocator.pools.size())
+        {
+            allocator.pools.push_back(CreateDescriptorPool());
+        }
+
+        allocInfo.descriptorPool = allocator.pools[allocator.poolIdx];
+
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkResult result = vkAllocateDescriptorSets(s_ctx.device, &allocInfo, &descriptorSet);
+        if (result == VK_SUCCESS)
+        {
+            allocator.poolSetCount++;
+            return descriptorSet;
+        }
+        else if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+        {
+            VK_ASSERT(result);
+        }
+
+        // Every further pool would fail the same way
+        assert(allocator.poolSetCount != 0 && "Descriptor set layout does not fit an empty descriptor pool");
+        if (allocator.poolSetCount == 0)
+        {
+            LOGE("Descriptor set layout does not fit an empty descriptor pool.\n");
+            return VK_NULL_HANDLE;
+        }
+
+        // Current pool is exhausted, move on to the next one
+        allocator.poolIdx++;
+        allocator.poolSetCount = 0;
+    }
+}
+
+static void ResetDescriptorAllocators(Frame& frame)
+{
+    for (DescriptorAllocator& allocator : frame.descriptorAllocators)
+    {
+        for (uint32_t i = 0; i <= allocator.poolIdx && i < allocator.pools.size(); ++i)
+        {
+            VK_ASSERT(vkResetDescriptorPool(s_ctx.device, allocator.pools[i], 0));
+        }
+        allocator.poolIdx = 0;
+        allocator.poolSetCount = 0;
+    }
+}
+
+static const char* GetMemoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+        case MEMORY_CATEGORY_GEOMETRY: return "Geometry";
+        case MEMORY_CATEGORY_TEXTURE: return "Texture";
+        case MEMORY_CATEGORY_RENDER_TARGET: return "RenderTarget";
+        case MEMORY_CATEGORY_STAGING: return "Staging";
+        case MEMORY_CATEGORY_ACCELERATION_STRUCTURE: return "AccelerationStructure";
+        case MEMORY_CATEGORY_TRANSIENT: return "Transient";
+        default: return "Unknown";
+    }
+}
+
+static void TrackAllocation(VmaAllocation allocation, MemoryCategory category, bool allocated)
+{
+    VmaAllocationInfo allocInfo;
+    vmaGetAllocationInfo(s_ctx.allocator, allocation, &allocInfo);
+
+    MemoryCategoryStats& stats = s_ctx.memoryStats.categories[category];
+    if (allocated)
+    {
+        stats.allocationBytes += allocInfo.size;
+        stats.allocationCount++;
+    }
+    else
+    {
+        stats.allocationBytes -= allocInfo.size;
+        stats.allocationCount--;
+    }
+}
+
+static VkBufferCreateInfo GetBufferCreateInfo(size_t size, VkBufferUsageFlags usage)
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Buffers are touched by both the copy and graphics queues, avoid ownership transfers
+    if (s_ctx.queueFamilies[QUEUE_COPY] != s_ctx.queueFamilies[QUEUE_GRAPHICS])
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = MAX_QUEUE_COUNT;
+        bufferInfo.pQueueFamilyIndices = s_ctx.queueFamilies;
+    }
+    return bufferInfo;
+}
+
+static VkBuffer CreateBufferHandle(size_t size, VkBufferUsageFlags usage)
+{
+    VkBufferCreateInfo bufferInfo = GetBufferCreateInfo(size, usage);
+    VkBuffer handle = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreateBuffer(s_ctx.device, &bufferInfo, nullptr, &handle));
+    return handle;
+}
+
+static VkDeviceAddress GetBufferDeviceAddress(VkBuffer handle, VkBufferUsageFlags usage)
+{
+    if (!(usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT))
+    {
+        return 0;
+    }
+
+    VkBufferDeviceAddressInfo addressInfo = {};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = handle;
+    return vkGetBufferDeviceAddress(s_ctx.device, &addressInfo);
+}
+
 static bool IsLayerSupported(const char* required, const std::vector<VkLayerProperties>& available)
 {
     for (const VkLayerProperties& availableLayer : available)
@@ -103,6 +508,177 @@ static bool IsExtensionSupported(const char* required, const std::vector<VkExten
     return false;
 }
 
+static void FinishDefragmentation()
+{
+    vmaEndDefragmentation(s_ctx.allocator, s_defrag.context, nullptr);
+    s_defrag.context = VK_NULL_HANDLE;
+    s_defrag.active = false;
+    s_defrag.stopRequested = false;
+}
+
+// Called once the frame that recorded the copies has retired. Moved buffers switched to their new memory
+// in that frame, so nothing in flight still reads the old memory vmaEndDefragmentationPass frees.
+static void EndDefragmentationPass()
+{
+    VkResult result = vmaEndDefragmentationPass(s_ctx.allocator, s_defrag.context, &s_defrag.pass);
+    s_defrag.passActive = false;
+
+    // The moves completed, these allocations now own the new memory the destroyed buffers last used
+    for (VmaAllocation allocation : s_defrag.destroyedAllocations)
+    {
+        s_resMgr.destroyerBuffers.push_back({{VK_NULL_HANDLE, allocation}, s_resMgr.frameCount});
+    }
+    s_defrag.destroyedAllocations.clear();
+
+    if (result == VK_SUCCESS)
+    {
+        FinishDefragmentation();
+    }
+    else if (result != VK_INCOMPLETE)
+    {
+        VK_ASSERT(result);
+    }
+}
+
+// Records the copies on the copy queue at the start of a frame and switches the buffers to their new memory
+// right away: the frame's graphics submit waits for the copies, so it and every later frame use the new handles.
+static void BeginDefragmentationPass()
+{
+    VkResult result = vmaBeginDefragmentationPass(s_ctx.allocator, s_defrag.context, &s_defrag.pass);
+    if (result == VK_SUCCESS)
+    {
+        FinishDefragmentation();
+        return;
+    }
+    else if (result != VK_INCOMPLETE)
+    {
+        VK_ASSERT(result);
+    }
+
+    s_defrag.passActive = true;
+    s_defrag.passFrameCount = s_ctx.frameCount;
+
+    // Earlier frames still in flight may write the sources on the graphics queue
+    AddSubmitWait(QUEUE_COPY, s_ctx.graphicsTimeline, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, s_ctx.frameCount);
+
+    CommandBuffer* cmd = GetCmdBuffer(QUEUE_COPY);
+    for (uint32_t i = 0; i < s_defrag.pass.moveCount; ++i)
+    {
+        VmaDefragmentationMove& move = s_defrag.pass.pMoves[i];
+
+        VmaAllocationInfo allocInfo;
+        vmaGetAllocationInfo(s_ctx.allocator, move.srcAllocation, &allocInfo);
+        Buffer* buffer = static_cast<Buffer*>(allocInfo.pUserData);
+        if (buffer == nullptr || buffer->mappedData != nullptr)
+        {
+            // Either already handed to the destroyer queue, or the host may still write
+            // through the old mapping while the copy is in flight.
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        VkBuffer dstBuffer = CreateBufferHandle(buffer->size, buffer->bufferUsage);
+        VK_ASSERT(vmaBindBufferMemory(s_ctx.allocator, move.dstTmpAllocation, dstBuffer));
+
+        // Orders the copy after earlier uploads to the source on this queue
+        Transition(cmd, buffer, RESOURCE_USE_TRANSFER_READ);
+        FlushBarriers(cmd);
+
+        VkBufferCopy region = {};
+        region.size = buffer->size;
+        cmd->recorded = true;
+        vkCmdCopyBuffer(cmd->handle, buffer->handle, dstBuffer, 1, &region);
+        // The copy wrote the new memory, later uses of the buffer wait for it
+        Transition(cmd, buffer, RESOURCE_USE_TRANSFER_WRITE);
+
+        // The old handle goes with frames up to this one, its memory stays with the allocation until the pass ends
+        s_resMgr.destroyerBuffers.push_back({{buffer->handle, VK_NULL_HANDLE}, s_resMgr.frameCount});
+        buffer->handle = dstBuffer;
+        buffer->deviceAddress = GetBufferDeviceAddress(buffer->handle, buffer->bufferUsage);
+    }
+}
+
+// Called at the start of a frame, after its fence has been waited on.
+static void UpdateDefragmentation()
+{
+    if (!s_defrag.active)
+    {
+        return;
+    }
+
+    if (s_defrag.passActive)
+    {
+        if (s_defrag.passFrameCount + MAX_FRAMES_IN_FLIGHT > s_ctx.frameCount)
+        {
+            return;
+        }
+        EndDefragmentationPass();
+    }
+
+    if (s_defrag.active && s_defrag.stopRequested)
+    {
+        FinishDefragmentation();
+    }
+
+    if (s_defrag.active)
+    {
+        BeginDefragmentationPass();
+    }
+}
+
+// Ends the pending pass early and stops. The device must be idle.
+static void AbortDefragmentation()
+{
+    if (!s_defrag.active)
+    {
+        return;
+    }
+
+    // Buffers already use their new memory, so the pass is completed rather than dropped
+    if (s_defrag.passActive)
+    {
+        EndDefragmentationPass();
+    }
+
+    if (s_defrag.active)
+    {
+        FinishDefragmentation();
+    }
+}
+
+// Ready pipelines may be bound from any recording thread while ApplyOptimizedPipelines swaps their handle
+static VkPipeline LoadPipelineHandle(const Pipeline* pipeline)
+{
+    return std::atomic_ref<VkPipeline>(const_cast<VkPipeline&>(pipeline->handle)).load(std::memory_order_acquire);
+}
+
+// Called on the recording thread at the start of a frame, like ApplyOptimizedPipelines
+static void DestroyDiscardedPipelines()
+{
+    std::vector<Pipeline*> discarded;
+    {
+        std::lock_guard<std::mutex> lock(s_pipelineMap.lock);
+        discarded.swap(s_pipelineMap.discarded);
+    }
+    for (Pipeline* pipeline : discarded)
+    {
+        DestroyPipeline(pipeline);
+    }
+}
+
+// Called on the recording thread at the start of a frame
+static void ApplyOptimizedPipelines()
+{
+    std::lock_guard<std::mutex> lock(s_compiler.lock);
+    for (auto& [pipeline, optimized] : s_compiler.optimized)
+    {
+        // The replaced handle stays valid for the frames that may still have it recorded
+        s_resMgr.destroyerPipelines.push_back({pipeline->handle, s_resMgr.frameCount});
+        std::atomic_ref<VkPipeline>(pipeline->handle).store(optimized, std::memory_order_release);
+    }
+    s_compiler.optimized.clear();
+}
+
 #ifdef VK_DEBUG
 VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsMessengerCB(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                                         VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -220,6 +796,9 @@ void Startup()
     }
     s_ctx.physicalDevice = gpus.front();
 
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(s_ctx.physicalDevice, &deviceProperties);
+
     s_ctx.properties2.pNext = &s_ctx.properties_1_1;
     s_ctx.properties_1_1.pNext = &s_ctx.properties_1_2;
     s_ctx.properties_1_2.pNext = &s_ctx.properties_1_3;
@@ -241,6 +820,22 @@ void Startup()
     std::vector<const char*> deviceExtensions;
     deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+    bool pushDescriptorKHR = false;
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_4)
+    {
+        *features_chain = &s_ctx.features_1_4;
+        features_chain = &s_ctx.features_1_4.pNext;
+        *properties_chain = &s_ctx.properties_1_4;
+        properties_chain = &s_ctx.properties_1_4.pNext;
+    }
+    else if (IsExtensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, deviceAvailableExtensions))
+    {
+        pushDescriptorKHR = true;
+        deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        *properties_chain = &s_ctx.pushDescriptorProperties;
+        properties_chain = &s_ctx.pushDescriptorProperties.pNext;
+    }
+
     if (IsExtensionSupported(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, deviceAvailableExtensions))
     {
         deviceExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
@@ -268,9 +863,53 @@ void Startup()
         }
     }
 
+    if (IsExtensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, deviceAvailableExtensions))
+    {
+        if (std::find_if(deviceExtensions.begin(), deviceExtensions.end(),
+                         [](const char* extension) { return strcmp(extension, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0; }) == deviceExtensions.end())
+        {
+            deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        }
+        deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        *features_chain = &s_ctx.graphicsPipelineLibraryFeatures;
+        features_chain = &s_ctx.graphicsPipelineLibraryFeatures.pNext;
+    }
+
+    if (IsExtensionSupported(VK_EXT_SHADER_OBJECT_EXTENSION_NAME, deviceAvailableExtensions))
+    {
+        deviceExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        *features_chain = &s_ctx.shaderObjectFeatures;
+        features_chain = &s_ctx.shaderObjectFeatures.pNext;
+    }
+
+    if (IsExtensionSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME, deviceAvailableExtensions))
+    {
+        deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        *features_chain = &s_ctx.meshShaderFeatures;
+        features_chain = &s_ctx.meshShaderFeatures.pNext;
+        *properties_chain = &s_ctx.meshShaderProperties;
+        properties_chain = &s_ctx.meshShaderProperties.pNext;
+    }
+
     vkGetPhysicalDeviceFeatures2(s_ctx.physicalDevice, &s_ctx.features2);
     vkGetPhysicalDeviceProperties2(s_ctx.physicalDevice, &s_ctx.properties2);
 
+    // These depend on multiview and fragment shading rate features that are not enabled
+    s_ctx.meshShaderFeatures.multiviewMeshShader = false;
+    s_ctx.meshShaderFeatures.primitiveFragmentShadingRateMeshShader = false;
+    s_ctx.meshShaderFeatures.meshShaderQueries = false;
+
+    if (s_ctx.features_1_4.pushDescriptor)
+    {
+        s_ctx.cmdPushDescriptorSetWithTemplate = vkCmdPushDescriptorSetWithTemplate;
+        s_ctx.maxPushDescriptors = s_ctx.properties_1_4.maxPushDescriptors;
+    }
+    else if (pushDescriptorKHR)
+    {
+        s_ctx.cmdPushDescriptorSetWithTemplate = vkCmdPushDescriptorSetWithTemplateKHR;
+        s_ctx.maxPushDescriptors = s_ctx.pushDescriptorProperties.maxPushDescriptors;
+    }
+
     uint32_t numQueueFamilies;
     vkGetPhysicalDeviceQueueFamilyProperties(s_ctx.physicalDevice, &numQueueFamilies, nullptr);
     std::vector<VkQueueFamilyProperties> queueFamilyProperties(numQueueFamilies);
@@ -383,14 +1022,44 @@ void Startup()
     }
     VK_ASSERT(vmaCreateAllocator(&allocatorInfo, &s_ctx.allocator));
 
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(s_ctx.allocator, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i)
+    {
+        const VkMemoryPropertyFlags barFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        const VkMemoryType& memoryType = memoryProperties->memoryTypes[i];
+        VkDeviceSize heapSize = memoryProperties->memoryHeaps[memoryType.heapIndex].size;
+        if ((memoryType.propertyFlags & barFlags) == barFlags && heapSize > LEGACY_BAR_HEAP_SIZE)
+        {
+            s_ctx.resizableBar = true;
+            LOGI("Resizable BAR: %llu MiB device-local host-visible heap.\n", (unsigned long long)(heapSize >> 20));
+            break;
+        }
+    }
+
+    VkPipelineCacheCreateInfo pipelineCacheInfo = {};
+    pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VK_ASSERT(vkCreatePipelineCache(s_ctx.device, &pipelineCacheInfo, nullptr, &s_ctx.pipelineCache));
+
     for (uint32_t i = 0; i < MAX_QUEUE_COUNT; ++i)
     {
+        s_ctx.queueFamilies[i] = queueFamilys[i];
         vkGetDeviceQueue(s_ctx.device, queueFamilys[i], 0, &s_ctx.queues[i]);
     }
 
+    assert(s_ctx.features_1_2.timelineSemaphore);
+    VkSemaphoreTypeCreateInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    VkSemaphoreCreateInfo timelineCreateInfo = {};
+    timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timelineCreateInfo.pNext = &timelineInfo;
+    VK_ASSERT(vkCreateSemaphore(s_ctx.device, &timelineCreateInfo, nullptr, &s_ctx.graphicsTimeline));
+
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         Frame& frame = s_ctx.frames[i];
+        frame.descriptorAllocators.resize(jobsystem::GetThreadCount() + 1);
 
         VkFenceCreateInfo fenceCreateInfo = {};
         fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -421,47 +1090,1721 @@ void Startup()
                 cmdInfo.commandPool = pool.handle;
                 cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
                 VK_ASSERT(vkAllocateCommandBuffers(s_ctx.device, &cmdInfo, &pool.commandBuffers[k].handle));
+                pool.commandBuffers[k].queueType = static_cast<QueueType>(j);
             }
 
-            VkCommandBufferBeginInfo cmdBeginInfo = {};
-            cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            cmdBeginInfo.pInheritanceInfo = nullptr;
-            VK_ASSERT(vkBeginCommandBuffer(pool.commandBuffers[0].handle, &cmdBeginInfo));
+            BeginCmdBuffer(pool.commandBuffers[0]);
+        }
+    }
+
+    BufferDesc stagingDesc = {};
+    stagingDesc.size = STAGING_RING_SIZE;
+    stagingDesc.memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY;
+    stagingDesc.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    stagingDesc.category = MEMORY_CATEGORY_STAGING;
+    s_staging.buffer = CreateBuffer(stagingDesc);
+
+    // Written in place in the resizable BAR when the device exposes one. The allocator needs a mapping,
+    // so a buffer that didn't land in the BAR heap is recreated in plain host-visible CPU_TO_GPU memory.
+    BufferDesc transientDesc = {};
+    transientDesc.size = TRANSIENT_BUFFER_SIZE;
+    transientDesc.memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    transientDesc.bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    transientDesc.category = MEMORY_CATEGORY_TRANSIENT;
+    transientDesc.hostWrite = true;
+    for (Buffer*& buffer : s_transient.buffers)
+    {
+        buffer = CreateBuffer(transientDesc);
+        if (buffer->mappedData == nullptr)
+        {
+            DestroyBuffer(buffer);
+            BufferDesc mappedDesc = transientDesc;
+            mappedDesc.hostWrite = false;
+            buffer = CreateBuffer(mappedDesc);
         }
     }
 }
 
 void Shutdown()
 {
+    jobsystem::Wait(s_compiler.counter);
     vkDeviceWaitIdle(s_ctx.device);
 
-#ifdef VK_DEBUG
-    if (s_ctx.debugMessenger != VK_NULL_HANDLE)
+    if (PipelineMapTable* table = s_pipelineMap.table.load(std::memory_order_relaxed))
     {
-        vkDestroyDebugUtilsMessengerEXT(s_ctx.instance, s_ctx.debugMessenger, nullptr);
-        s_ctx.debugMessenger = VK_NULL_HANDLE;
+        for (uint32_t i = 0; i < table->capacity; ++i)
+        {
+            if (table->slots[i].hash.load(std::memory_order_relaxed) != 0)
+            {
+                DestroyPipeline(table->slots[i].pipeline);
+            }
+        }
+    }
+    DestroyDiscardedPipelines();
+    s_pipelineMap.table.store(nullptr, std::memory_order_relaxed);
+    s_pipelineMap.tables.clear();
+    s_pipelineMap.count = 0;
+
+    ApplyOptimizedPipelines();
+    for (auto& [key, library] : s_compiler.libraries)
+    {
+        s_resMgr.destroyerPipelines.push_back({library, s_resMgr.frameCount});
+    }
+    s_compiler.libraries.clear();
+
+    AbortDefragmentation();
+    StopPipelineStateRecording();
+    DestroyBuffer(s_staging.buffer);
+    s_staging.buffer = nullptr;
+    s_staging.regions.clear();
+    for (Buffer*& buffer : s_transient.buffers)
+    {
+        DestroyBuffer(buffer);
+        buffer = nullptr;
     }
-#endif
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
-        Frame& frame = s_ctx.frames[i];
-
-        vkDestroyFence(s_ctx.device, frame.fence, nullptr);
-
-        vkDestroySemaphore(s_ctx.device, frame.copySemaphore, nullptr);
-        vkDestroySemaphore(s_ctx.device, frame.acquireSemaphore, nullptr);
-        vkDestroySemaphore(s_ctx.device, frame.releaseSemaphore, nullptr);
-
-        for (uint32_t j = 0; j < MAX_QUEUE_COUNT; ++j)
+        for (std::unique_ptr<SplitBarrier>& barrier : s_splitBarriers.barriers[i])
+        {
+            vkDestroyEvent(s_ctx.device, barrier->event, nullptr);
+        }
+        s_splitBarriers.barriers[i].clear();
+        s_splitBarriers.counts[i] = 0;
+    }
+    for (Frame& frame : s_ctx.frames)
+    {
+        for (DescriptorAllocator& allocator : frame.descriptorAllocators)
+        {
+            for (VkDescriptorPool pool : allocator.pools)
+            {
+                s_resMgr.destroyerDescriptorPools.push_back({pool, s_resMgr.frameCount});
+            }
+            allocator.pools.clear();
+        }
+    }
+    s_resMgr.Update(s_ctx.device, s_ctx.allocator, UINT64_MAX, 0);
+
+    s_buffers.ForEach([](BufferHandle, const Buffer& buffer) {
+        LOGW("Leaked %s buffer of %zu bytes.\n", GetMemoryCategoryName(buffer.category), buffer.size);
+    });
+    s_textures.ForEach([](TextureHandle, const Texture& texture) {
+        LOGW("Leaked %s texture of %ux%u.\n", GetMemoryCategoryName(texture.category), texture.width, texture.height);
+    });
+
+#ifdef VK_DEBUG
+    if (s_ctx.debugMessenger != VK_NULL_HANDLE)
+    {
+        vkDestroyDebugUtilsMessengerEXT(s_ctx.instance, s_ctx.debugMessenger, nullptr);
+        s_ctx.debugMessenger = VK_NULL_HANDLE;
+    }
+#endif
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        Frame& frame = s_ctx.frames[i];
+
+        vkDestroyFence(s_ctx.device, frame.fence, nullptr);
+
+        vkDestroySemaphore(s_ctx.device, frame.copySemaphore, nullptr);
+        vkDestroySemaphore(s_ctx.device, frame.acquireSemaphore, nullptr);
+        vkDestroySemaphore(s_ctx.device, frame.releaseSemaphore, nullptr);
+
+        for (uint32_t j = 0; j < MAX_QUEUE_COUNT; ++j)
         {
             CommandPool& pool = frame.pools[j];
             vkDestroyCommandPool(s_ctx.device, pool.handle, nullptr);
         }
     }
-    vmaDestroyAllocator(s_ctx.allocator);
-    vkDestroyDevice(s_ctx.device, nullptr);
-    vkDestroyInstance(s_ctx.instance, nullptr);
+    vkDestroySemaphore(s_ctx.device, s_ctx.graphicsTimeline, nullptr);
+    vkDestroyPipelineCache(s_ctx.device, s_ctx.pipelineCache, nullptr);
+    vmaDestroyAllocator(s_ctx.allocator);
+    vkDestroyDevice(s_ctx.device, nullptr);
+    vkDestroyInstance(s_ctx.instance, nullptr);
+}
+
+uint64_t GetFrameCount()
+{
+    return s_ctx.frameCount;
+}
+
+Buffer* CreateBuffer(const BufferDesc& desc)
+{
+    BufferHandle id = s_buffers.Allocate();
+    Buffer* buffer = s_buffers.Get(id);
+    buffer->id = id;
+    buffer->size = desc.size;
+    buffer->memoryUsage = desc.memoryUsage;
+    // Transfer usage lets the defragmenter copy any buffer to its new place
+    buffer->bufferUsage = desc.bufferUsage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer->category = desc.category;
+    if (s_ctx.features_1_2.bufferDeviceAddress)
+    {
+        buffer->bufferUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    }
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = desc.memoryUsage;
+    allocInfo.pUserData = buffer;
+    VmaAllocationInfo allocationInfo = {};
+
+    if (desc.hostWrite && s_ctx.resizableBar)
+    {
+        // VMA prefers device-local host-visible memory and falls back to device memory without a mapping
+        // when that heap is full. The AUTO usages need the create info, so the buffer is created by VMA.
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                          VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+                          VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        VkBufferCreateInfo bufferInfo = GetBufferCreateInfo(buffer->size, buffer->bufferUsage);
+        VK_ASSERT(vmaCreateBuffer(s_ctx.allocator, &bufferInfo, &allocInfo, &buffer->handle, &buffer->allocation, &allocationInfo));
+    }
+    else
+    {
+        if (desc.memoryUsage == VMA_MEMORY_USAGE_CPU_ONLY ||
+            desc.memoryUsage == VMA_MEMORY_USAGE_CPU_TO_GPU ||
+            desc.memoryUsage == VMA_MEMORY_USAGE_GPU_TO_CPU ||
+            desc.memoryUsage == VMA_MEMORY_USAGE_CPU_COPY)
+        {
+            allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        }
+
+        buffer->handle = CreateBufferHandle(buffer->size, buffer->bufferUsage);
+        VK_ASSERT(vmaAllocateMemoryForBuffer(s_ctx.allocator, buffer->handle, &allocInfo, &buffer->allocation, &allocationInfo));
+        VK_ASSERT(vmaBindBufferMemory(s_ctx.allocator, buffer->allocation, buffer->handle));
+    }
+    buffer->mappedData = allocationInfo.pMappedData;
+    vmaSetAllocationName(s_ctx.allocator, buffer->allocation, GetMemoryCategoryName(buffer->category));
+    TrackAllocation(buffer->allocation, buffer->category, true);
+
+    buffer->deviceAddress = GetBufferDeviceAddress(buffer->handle, buffer->bufferUsage);
+    return buffer;
+}
+
+void DestroyBuffer(Buffer* buffer)
+{
+    if (buffer == nullptr)
+    {
+        return;
+    }
+    assert(IsAlive(buffer) && "Destroyed a buffer twice");
+
+    TrackAllocation(buffer->allocation, buffer->category, false);
+
+    // Detach from the defragmenter first, the allocation outlives the Buffer in the destroyer queue
+    vmaSetAllocationUserData(s_ctx.allocator, buffer->allocation, nullptr);
+    if (s_defrag.passActive)
+    {
+        for (uint32_t i = 0; i < s_defrag.pass.moveCount; ++i)
+        {
+            const VmaDefragmentationMove& move = s_defrag.pass.pMoves[i];
+            if (move.srcAllocation == buffer->allocation && move.operation == VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY)
+            {
+                // The allocation must live until the pass ends, and frames still in flight may use its new memory after that
+                s_resMgr.destroyerBuffers.push_back({{buffer->handle, VK_NULL_HANDLE}, s_resMgr.frameCount});
+                s_defrag.destroyedAllocations.push_back(buffer->allocation);
+                s_buffers.Free(buffer->id);
+                return;
+            }
+        }
+    }
+
+    s_resMgr.destroyerBuffers.push_back({{buffer->handle, buffer->allocation}, s_resMgr.frameCount});
+    s_buffers.Free(buffer->id);
+}
+
+void FlushBuffer(const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+    VK_ASSERT(vmaFlushAllocation(s_ctx.allocator, buffer->allocation, offset, size));
+}
+
+void InvalidateBuffer(const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+    VK_ASSERT(vmaInvalidateAllocation(s_ctx.allocator, buffer->allocation, offset, size));
+}
+
+bool WriteBuffer(CommandBuffer* cmd, Buffer* buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+    assert(offset + size <= buffer->size);
+    if (buffer->mappedData != nullptr)
+    {
+        memcpy(static_cast<uint8_t*>(buffer->mappedData) + offset, data, size);
+        FlushBuffer(buffer, offset, size);
+        return true;
+    }
+
+    StagingAllocation staging = ReserveStaging(size);
+    if (staging.data == nullptr)
+    {
+        return false;
+    }
+    memcpy(staging.data, data, size);
+    CommitStaging(staging);
+
+    Transition(cmd, buffer, RESOURCE_USE_TRANSFER_WRITE);
+    CmdCopyBuffer(cmd, staging.buffer, staging.offset, buffer, offset, size);
+    return true;
+}
+
+StagingAllocation ReserveStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+    std::lock_guard<std::mutex> lock(s_staging.lock);
+    VkDeviceSize capacity = s_staging.buffer->size;
+    VkDeviceSize offset = (s_staging.head + alignment - 1) / alignment * alignment;
+    if (offset + size > capacity)
+    {
+        // Never split a region, skip the end of the ring instead
+        offset = 0;
+    }
+
+    VkDeviceSize end = offset + size;
+    VkDeviceSize required = offset >= s_staging.head ? end - s_staging.head : capacity - s_staging.head + end;
+    if (size > capacity || s_staging.usedBytes + required > capacity)
+    {
+        return {s_staging.buffer, 0, nullptr};
+    }
+
+    s_staging.head = end;
+    s_staging.usedBytes += required;
+    s_staging.regions.push_back({offset, required, UINT64_MAX});
+    return {s_staging.buffer, offset, static_cast<uint8_t*>(s_staging.buffer->mappedData) + offset};
+}
+
+void CommitStaging(const StagingAllocation& allocation)
+{
+    std::lock_guard<std::mutex> lock(s_staging.lock);
+    // Recent regions are committed first, search from the back
+    for (auto it = s_staging.regions.rbegin(); it != s_staging.regions.rend(); ++it)
+    {
+        if (it->offset == allocation.offset && it->frameCount == UINT64_MAX)
+        {
+            it->frameCount = s_ctx.frameCount;
+            return;
+        }
+    }
+    assert(false && "Committed a staging region that was not reserved");
+}
+
+StagingAllocation AllocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+    StagingAllocation allocation = ReserveStaging(size, alignment);
+    if (allocation.data != nullptr)
+    {
+        CommitStaging(allocation);
+    }
+    return allocation;
+}
+
+static void ReleaseStaging(uint64_t frameCount)
+{
+    std::lock_guard<std::mutex> lock(s_staging.lock);
+    while (!s_staging.regions.empty() &&
+           s_staging.regions.front().frameCount != UINT64_MAX &&
+           s_staging.regions.front().frameCount + MAX_FRAMES_IN_FLIGHT <= frameCount)
+    {
+        s_staging.usedBytes -= s_staging.regions.front().size;
+        s_staging.regions.pop_front();
+    }
+}
+
+TransientAllocation AllocateTransient(VkDeviceSize size, VkDeviceSize alignment)
+{
+    const VkPhysicalDeviceLimits& limits = s_ctx.properties2.properties.limits;
+    alignment = std::max({alignment, limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment});
+
+    Buffer* buffer = s_transient.buffers[GetFrameIndex()];
+    VkDeviceSize head = s_transient.head.load(std::memory_order_relaxed);
+    VkDeviceSize offset = 0;
+    do
+    {
+        offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > buffer->size)
+        {
+            return {buffer, 0, 0, nullptr};
+        }
+    } while (!s_transient.head.compare_exchange_weak(head, offset + size, std::memory_order_relaxed));
+
+    return {buffer, offset, buffer->deviceAddress + offset, static_cast<uint8_t*>(buffer->mappedData) + offset};
+}
+
+static bool IsDepthFormat(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Texture* CreateTexture(const TextureDesc& desc)
+{
+    TextureHandle id = s_textures.Allocate();
+    Texture* texture = s_textures.Get(id);
+    texture->id = id;
+    texture->width = desc.width;
+    texture->height = desc.height;
+    texture->mipLevels = desc.mipLevels;
+    texture->format = desc.format;
+    texture->usage = desc.usage;
+    texture->category = desc.category;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = desc.format;
+    imageInfo.extent = {desc.width, desc.height, 1};
+    imageInfo.mipLevels = desc.mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = desc.usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (s_ctx.queueFamilies[QUEUE_COPY] != s_ctx.queueFamilies[QUEUE_GRAPHICS])
+    {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = MAX_QUEUE_COUNT;
+        imageInfo.pQueueFamilyIndices = s_ctx.queueFamilies;
+    }
+
+    // No user data, the defragmenter only moves buffers
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocationInfo allocationInfo = {};
+    VK_ASSERT(vmaCreateImage(s_ctx.allocator, &imageInfo, &allocInfo, &texture->handle, &texture->allocation, &allocationInfo));
+    texture->size = allocationInfo.size;
+    vmaSetAllocationName(s_ctx.allocator, texture->allocation, GetMemoryCategoryName(texture->category));
+    TrackAllocation(texture->allocation, texture->category, true);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = texture->handle;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = desc.format;
+    viewInfo.subresourceRange.aspectMask = IsDepthFormat(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = desc.mipLevels;
+    viewInfo.subresourceRange.layerCount = 1;
+    VK_ASSERT(vkCreateImageView(s_ctx.device, &viewInfo, nullptr, &texture->view));
+    return texture;
+}
+
+void DestroyTexture(Texture* texture)
+{
+    if (texture == nullptr)
+    {
+        return;
+    }
+    assert(IsAlive(texture) && "Destroyed a texture twice");
+
+    TrackAllocation(texture->allocation, texture->category, false);
+    s_resMgr.destroyerImageviews.push_back({texture->view, s_resMgr.frameCount});
+    s_resMgr.destroyerImages.push_back({{texture->handle, texture->allocation}, s_resMgr.frameCount});
+    s_textures.Free(texture->id);
+}
+
+Buffer* GetBuffer(BufferHandle handle)
+{
+    return s_buffers.Get(handle);
+}
+
+Texture* GetTexture(TextureHandle handle)
+{
+    return s_textures.Get(handle);
+}
+
+bool IsAlive(const Buffer* buffer)
+{
+    return s_buffers.IsAlive(buffer->id);
+}
+
+bool IsAlive(const Texture* texture)
+{
+    return s_textures.IsAlive(texture->id);
+}
+
+VkDeviceSize GetTextureDataSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    VkDeviceSize blockCount = VkDeviceSize(width) * height;
+    uint32_t blockSize = 0;
+    switch (format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            blockCount = VkDeviceSize((width + 3) / 4) * ((height + 3) / 4);
+            blockSize = 8;
+            break;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            blockCount = VkDeviceSize((width + 3) / 4) * ((height + 3) / 4);
+            blockSize = 16;
+            break;
+        case VK_FORMAT_R8_UNORM:
+            blockSize = 1;
+            break;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            blockSize = 2;
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R16G16_SFLOAT:
+            blockSize = 4;
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            blockSize = 8;
+            break;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            blockSize = 16;
+            break;
+        default:
+            LOGE("Unsupported texture format %d.\n", format);
+            assert(false);
+            break;
+    }
+    return blockCount * blockSize;
+}
+
+bool IsFormatSupported(VkFormat format, VkFormatFeatureFlags2 features)
+{
+    VkFormatProperties3 properties3 = {};
+    properties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+
+    VkFormatProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+    properties2.pNext = &properties3;
+    vkGetPhysicalDeviceFormatProperties2(s_ctx.physicalDevice, format, &properties2);
+    return (properties3.optimalTilingFeatures & features) == features;
+}
+
+bool IsMeshShaderSupported()
+{
+    return s_ctx.meshShaderFeatures.taskShader && s_ctx.meshShaderFeatures.meshShader;
+}
+
+bool IsResizableBarSupported()
+{
+    return s_ctx.resizableBar;
+}
+
+MemoryStats GetMemoryStats()
+{
+    return s_ctx.memoryStats;
+}
+
+bool DumpMemoryStats(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        LOGE("Failed to open %s for memory stats.\n", path);
+        return false;
+    }
+
+    char* statsString = nullptr;
+    vmaBuildStatsString(s_ctx.allocator, &statsString, VK_TRUE);
+    size_t length = strlen(statsString);
+    bool written = fwrite(statsString, 1, length, file) == length;
+    vmaFreeStatsString(s_ctx.allocator, statsString);
+    fclose(file);
+
+    if (!written)
+    {
+        LOGE("Failed to write memory stats to %s.\n", path);
+    }
+    return written;
+}
+
+void BeginDefragmentation(uint32_t maxMovesPerPass, VkDeviceSize maxBytesPerPass)
+{
+    if (s_defrag.active)
+    {
+        s_defrag.stopRequested = false;
+        return;
+    }
+
+    VmaDefragmentationInfo defragInfo = {};
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    defragInfo.maxBytesPerPass = maxBytesPerPass;
+    defragInfo.maxAllocationsPerPass = maxMovesPerPass;
+    VK_ASSERT(vmaBeginDefragmentation(s_ctx.allocator, &defragInfo, &s_defrag.context));
+    s_defrag.active = true;
+}
+
+void EndDefragmentation()
+{
+    if (!s_defrag.active)
+    {
+        return;
+    }
+
+    // An in-flight pass still owns GPU copies, let it retire first
+    if (s_defrag.passActive)
+    {
+        s_defrag.stopRequested = true;
+        return;
+    }
+
+    FinishDefragmentation();
+}
+
+bool IsDefragmenting()
+{
+    return s_defrag.active;
+}
+
+Shader* CreateShader(std::span<const uint32_t> spirv)
+{
+    SpvReflectShaderModule reflectModule;
+    if (spvReflectCreateShaderModule(spirv.size_bytes(), spirv.data(), &reflectModule) != SPV_REFLECT_RESULT_SUCCESS)
+    {
+        LOGE("Failed to reflect SPIR-V module.\n");
+        return nullptr;
+    }
+
+    Shader* shader = new Shader();
+    shader->hash = Hash(spirv.data(), spirv.size_bytes());
+    shader->stage = static_cast<VkShaderStageFlagBits>(reflectModule.shader_stage);
+    shader->entryPoint = reflectModule.entry_point_name;
+    shader->pushConstantSize = 0;
+    for (uint32_t i = 0; i < reflectModule.push_constant_block_count; ++i)
+    {
+        const SpvReflectBlockVariable& block = reflectModule.push_constant_blocks[i];
+        shader->pushConstantSize = std::max(shader->pushConstantSize, block.offset + block.size);
+    }
+
+    for (uint32_t i = 0; i < reflectModule.descriptor_set_count; ++i)
+    {
+        const SpvReflectDescriptorSet& set = reflectModule.descriptor_sets[i];
+        if (set.set >= MAX_DESCRIPTOR_SET_COUNT)
+        {
+            LOGE("Descriptor set %u exceeds MAX_DESCRIPTOR_SET_COUNT.\n", set.set);
+            continue;
+        }
+
+        for (uint32_t j = 0; j < set.binding_count; ++j)
+        {
+            const SpvReflectDescriptorBinding* reflectBinding = set.bindings[j];
+
+            VkDescriptorSetLayoutBinding binding = {};
+            binding.binding = reflectBinding->binding;
+            binding.descriptorType = static_cast<VkDescriptorType>(reflectBinding->descriptor_type);
+            binding.descriptorCount = std::max(reflectBinding->count, 1u);
+            binding.stageFlags = shader->stage;
+            shader->descriptorBindings[set.set].push_back(binding);
+        }
+
+        std::sort(shader->descriptorBindings[set.set].begin(), shader->descriptorBindings[set.set].end(),
+                  [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+    }
+    spvReflectDestroyShaderModule(&reflectModule);
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = spirv.size_bytes();
+    moduleInfo.pCode = spirv.data();
+    VK_ASSERT(vkCreateShaderModule(s_ctx.device, &moduleInfo, nullptr, &shader->handle));
+
+    if (s_ctx.shaderObjectFeatures.shaderObject)
+    {
+        shader->spirv.assign(spirv.begin(), spirv.end());
+    }
+    return shader;
+}
+
+void DestroyShader(Shader* shader)
+{
+    if (shader == nullptr)
+    {
+        return;
+    }
+
+    s_resMgr.destroyerShaderModules.push_back({shader->handle, s_resMgr.frameCount});
+    delete shader;
+}
+
+static Pipeline* CreatePipelineLayout(VkPipelineBindPoint bindPoint, std::span<const Shader* const> shaders)
+{
+    Pipeline* pipeline = new Pipeline();
+    pipeline->bindPoint = bindPoint;
+    pipeline->pushConstantStages = 0;
+    pipeline->pushConstantSize = 0;
+    pipeline->pushDescriptorSet = UINT32_MAX;
+    for (const Shader* shader : shaders)
+    {
+        if (shader != nullptr && shader->pushConstantSize > 0)
+        {
+            pipeline->pushConstantStages |= shader->stage;
+            pipeline->pushConstantSize = std::max(pipeline->pushConstantSize, shader->pushConstantSize);
+        }
+    }
+
+    if (pipeline->pushConstantSize > s_ctx.properties2.properties.limits.maxPushConstantsSize)
+    {
+        LOGE("Push constant block of %u bytes exceeds the device limit of %u.\n",
+             pipeline->pushConstantSize, s_ctx.properties2.properties.limits.maxPushConstantsSize);
+        assert(false);
+    }
+
+    // Merge the bindings of every stage, set by set
+    std::vector<VkDescriptorSetLayoutBinding> setBindings[MAX_DESCRIPTOR_SET_COUNT];
+    pipeline->descriptorSetCount = 0;
+    for (uint32_t set = 0; set < MAX_DESCRIPTOR_SET_COUNT; ++set)
+    {
+        std::vector<VkDescriptorSetLayoutBinding>& bindings = setBindings[set];
+        for (const Shader* shader : shaders)
+        {
+            if (shader == nullptr)
+            {
+                continue;
+            }
+
+            for (const VkDescriptorSetLayoutBinding& binding : shader->descriptorBindings[set])
+            {
+                auto it = std::find_if(bindings.begin(), bindings.end(),
+                                       [&](const VkDescriptorSetLayoutBinding& existing) { return existing.binding == binding.binding; });
+                if (it != bindings.end())
+                {
+                    assert(it->descriptorType == binding.descriptorType);
+                    it->stageFlags |= binding.stageFlags;
+                }
+                else
+                {
+                    bindings.push_back(binding);
+                }
+            }
+        }
+        std::sort(bindings.begin(), bindings.end(),
+                  [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+        pipeline->descriptorCounts[set] = 0;
+        for (const VkDescriptorSetLayoutBinding& binding : bindings)
+        {
+            pipeline->descriptorCounts[set] += binding.descriptorCount;
+        }
+
+        if (!bindings.empty())
+        {
+            pipeline->descriptorSetCount = set + 1;
+        }
+    }
+
+    for (uint32_t set = 0; set < pipeline->descriptorSetCount; ++set)
+    {
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = (uint32_t)setBindings[set].size();
+        setLayoutInfo.pBindings = setBindings[set].data();
+
+        // Per-draw bindings are pushed straight into the command buffer when the device allows it
+        if (set == PUSH_DESCRIPTOR_SET &&
+            s_ctx.cmdPushDescriptorSetWithTemplate != nullptr &&
+            pipeline->descriptorCounts[set] <= s_ctx.maxPushDescriptors)
+        {
+            setLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT;
+            pipeline->pushDescriptorSet = set;
+        }
+        VK_ASSERT(vkCreateDescriptorSetLayout(s_ctx.device, &setLayoutInfo, nullptr, &pipeline->descriptorSetLayouts[set]));
+    }
+
+    // Identically defined layouts are interchangeable, which lets pipeline library parts be shared
+    pipeline->layoutHash = HashCombine(HashCombine(pipeline->pushConstantStages, pipeline->pushConstantSize), pipeline->pushDescriptorSet);
+    for (uint32_t set = 0; set < pipeline->descriptorSetCount; ++set)
+    {
+        for (const VkDescriptorSetLayoutBinding& binding : setBindings[set])
+        {
+            pipeline->layoutHash = HashCombine(pipeline->layoutHash, (uint64_t)set << 32 | binding.binding);
+            pipeline->layoutHash = HashCombine(pipeline->layoutHash, (uint64_t)binding.descriptorType << 32 | binding.descriptorCount);
+            pipeline->layoutHash = HashCombine(pipeline->layoutHash, binding.stageFlags);
+        }
+    }
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = pipeline->pushConstantStages;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pipeline->pushConstantSize;
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = pipeline->descriptorSetCount;
+    layoutInfo.pSetLayouts = pipeline->descriptorSetLayouts;
+    if (pipeline->pushConstantSize > 0)
+    {
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+    }
+    VK_ASSERT(vkCreatePipelineLayout(s_ctx.device, &layoutInfo, nullptr, &pipeline->layout));
+
+    for (uint32_t set = 0; set < MAX_DESCRIPTOR_SET_COUNT; ++set)
+    {
+        pipeline->descriptorUpdateTemplates[set] = VK_NULL_HANDLE;
+        if (setBindings[set].empty())
+        {
+            continue;
+        }
+
+        uint32_t descriptorIdx = 0;
+        std::vector<VkDescriptorUpdateTemplateEntry> entries(setBindings[set].size());
+        for (size_t i = 0; i < setBindings[set].size(); ++i)
+        {
+            const VkDescriptorSetLayoutBinding& binding = setBindings[set][i];
+            VkDescriptorUpdateTemplateEntry& entry = entries[i];
+            entry.dstBinding = binding.binding;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = binding.descriptorCount;
+            entry.descriptorType = binding.descriptorType;
+            entry.offset = descriptorIdx * sizeof(DescriptorInfo);
+            entry.stride = sizeof(DescriptorInfo);
+            descriptorIdx += binding.descriptorCount;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo templateInfo = {};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateInfo.descriptorUpdateEntryCount = (uint32_t)entries.size();
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        if (set == pipeline->pushDescriptorSet)
+        {
+            templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS;
+            templateInfo.pipelineBindPoint = bindPoint;
+            templateInfo.pipelineLayout = pipeline->layout;
+            templateInfo.set = set;
+        }
+        else
+        {
+            templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+            templateInfo.descriptorSetLayout = pipeline->descriptorSetLayouts[set];
+        }
+        VK_ASSERT(vkCreateDescriptorUpdateTemplate(s_ctx.device, &templateInfo, nullptr, &pipeline->descriptorUpdateTemplates[set]));
+    }
+    return pipeline;
+}
+
+static VkPipelineShaderStageCreateInfo GetShaderStageInfo(const Shader* shader)
+{
+    VkPipelineShaderStageCreateInfo stageInfo = {};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = shader->stage;
+    stageInfo.module = shader->handle;
+    stageInfo.pName = shader->entryPoint.c_str();
+    return stageInfo;
+}
+
+static void CompileComputePipeline(Pipeline* pipeline, const Shader* computeShader)
+{
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = GetShaderStageInfo(computeShader);
+    pipelineInfo.layout = pipeline->layout;
+    VK_ASSERT(vkCreateComputePipelines(s_ctx.device, s_ctx.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline->handle));
+}
+
+// Fixed-function state of a GraphicsPipelineDesc, shared by monolithic pipelines and library parts
+struct GraphicsPipelineState
+{
+    uint32_t stageCount = 0;
+    VkPipelineShaderStageCreateInfo stages[3] = {};
+    VkVertexInputBindingDescription vertexBinding = {};
+    VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+    VkPipelineMultisampleStateCreateInfo multisampleState = {};
+    VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+    std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+    VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+    VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    VkPipelineRenderingCreateInfo renderingInfo = {};
+};
+
+// In stage order, unused stages are null
+static std::array<const Shader*, 3> GetGraphicsShaders(const GraphicsPipelineDesc& desc)
+{
+    if (desc.meshShader != nullptr)
+    {
+        return {desc.taskShader, desc.meshShader, desc.fragmentShader};
+    }
+    return {desc.vertexShader, desc.fragmentShader, nullptr};
+}
+
+static void InitGraphicsPipelineState(GraphicsPipelineState& state, const GraphicsPipelineDesc& desc)
+{
+    for (const Shader* shader : GetGraphicsShaders(desc))
+    {
+        if (shader != nullptr)
+        {
+            state.stages[state.stageCount++] = GetShaderStageInfo(shader);
+        }
+    }
+
+    // Without a vertex layout, vertices are pulled from device-address buffers and there is no fixed-function vertex input
+    state.vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    if (desc.vertexStride > 0)
+    {
+        state.vertexBinding.binding = 0;
+        state.vertexBinding.stride = desc.vertexStride;
+        state.vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        state.vertexInputState.vertexBindingDescriptionCount = 1;
+        state.vertexInputState.pVertexBindingDescriptions = &state.vertexBinding;
+        state.vertexInputState.vertexAttributeDescriptionCount = (uint32_t)desc.vertexAttributes.size();
+        state.vertexInputState.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+    }
+
+    state.inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    state.inputAssemblyState.topology = desc.topology;
+
+    state.viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+
+    state.rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    state.rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+    state.rasterizationState.cullMode = desc.cullMode;
+    state.rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    state.rasterizationState.lineWidth = 1.0f;
+
+    state.multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    state.multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    state.depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    state.depthStencilState.depthTestEnable = desc.depthTest;
+    state.depthStencilState.depthWriteEnable = desc.depthWrite;
+    state.depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    state.blendAttachments.resize(desc.colorFormats.size());
+    for (VkPipelineColorBlendAttachmentState& blendAttachment : state.blendAttachments)
+    {
+        blendAttachment = {};
+        blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    }
+
+    state.colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    state.colorBlendState.attachmentCount = (uint32_t)state.blendAttachments.size();
+    state.colorBlendState.pAttachments = state.blendAttachments.data();
+
+    state.dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    state.dynamicState.dynamicStateCount = (uint32_t)std::size(state.dynamicStates);
+    state.dynamicState.pDynamicStates = state.dynamicStates;
+
+    state.renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    state.renderingInfo.colorAttachmentCount = (uint32_t)desc.colorFormats.size();
+    state.renderingInfo.pColorAttachmentFormats = desc.colorFormats.data();
+    state.renderingInfo.depthAttachmentFormat = desc.depthFormat;
+}
+
+static VkPipeline CreateGraphicsPipelineLibrary(VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineState& state, VkPipelineLayout layout)
+{
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = {};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = part;
+
+    VkPipelineRenderingCreateInfo renderingInfo = state.renderingInfo;
+    renderingInfo.pNext = &libraryInfo;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &renderingInfo;
+    pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    switch (part)
+    {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            pipelineInfo.pVertexInputState = &state.vertexInputState;
+            pipelineInfo.pInputAssemblyState = &state.inputAssemblyState;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            pipelineInfo.stageCount = 1;
+            pipelineInfo.pStages = &state.stages[0];
+            pipelineInfo.pViewportState = &state.viewportState;
+            pipelineInfo.pRasterizationState = &state.rasterizationState;
+            pipelineInfo.pDynamicState = &state.dynamicState;
+            pipelineInfo.layout = layout;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            pipelineInfo.stageCount = state.stageCount - 1;
+            pipelineInfo.pStages = state.stageCount > 1 ? &state.stages[1] : nullptr;
+            pipelineInfo.pMultisampleState = &state.multisampleState;
+            pipelineInfo.pDepthStencilState = &state.depthStencilState;
+            pipelineInfo.layout = layout;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+            pipelineInfo.pMultisampleState = &state.multisampleState;
+            pipelineInfo.pColorBlendState = &state.colorBlendState;
+            break;
+    }
+
+    VkPipeline library = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreateGraphicsPipelines(s_ctx.device, s_ctx.pipelineCache, 1, &pipelineInfo, nullptr, &library));
+    return library;
+}
+
+// Library parts are shared between every pipeline with the same state for that part
+static VkPipeline GetGraphicsPipelineLibrary(VkGraphicsPipelineLibraryFlagsEXT part, uint64_t key, const GraphicsPipelineState& state, VkPipelineLayout layout)
+{
+    key = HashCombine(key, part);
+    {
+        std::lock_guard<std::mutex> lock(s_compiler.lock);
+        auto it = s_compiler.libraries.find(key);
+        if (it != s_compiler.libraries.end())
+        {
+            return it->second;
+        }
+    }
+
+    VkPipeline library = CreateGraphicsPipelineLibrary(part, state, layout);
+
+    std::lock_guard<std::mutex> lock(s_compiler.lock);
+    auto [it, inserted] = s_compiler.libraries.emplace(key, library);
+    if (!inserted)
+    {
+        // Another thread built the same part meanwhile
+        vkDestroyPipeline(s_ctx.device, library, nullptr);
+    }
+    return it->second;
+}
+
+static VkPipeline LinkGraphicsPipeline(const Pipeline* pipeline, const GraphicsPipelineDesc& desc, bool linkTimeOptimization)
+{
+    GraphicsPipelineState state;
+    InitGraphicsPipelineState(state, desc);
+
+    uint64_t vertexInputKey = HashCombine(HashCombine(Hash(desc.vertexAttributes.data(), desc.vertexAttributes.size_bytes()), desc.vertexStride),
+                                          desc.topology);
+    uint64_t preRasterizationKey = HashCombine(HashCombine(pipeline->layoutHash, desc.vertexShader->hash), desc.cullMode);
+    uint64_t fragmentShaderKey = HashCombine(HashCombine(pipeline->layoutHash, desc.fragmentShader != nullptr ? desc.fragmentShader->hash : 0),
+                                             (uint64_t)desc.depthTest << 1 | (uint64_t)desc.depthWrite);
+    uint64_t fragmentOutputKey = HashCombine(Hash(desc.colorFormats.data(), desc.colorFormats.size_bytes()), desc.depthFormat);
+
+    VkPipeline libraries[] = {
+        GetGraphicsPipelineLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, vertexInputKey, state, pipeline->layout),
+        GetGraphicsPipelineLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, preRasterizationKey, state, pipeline->layout),
+        GetGraphicsPipelineLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, fragmentShaderKey, state, pipeline->layout),
+        GetGraphicsPipelineLibrary(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, fragmentOutputKey, state, pipeline->layout),
+    };
+
+    VkPipelineLibraryCreateInfoKHR linkInfo = {};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = (uint32_t)std::size(libraries);
+    linkInfo.pLibraries = libraries;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    pipelineInfo.flags = linkTimeOptimization ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = pipeline->layout;
+
+    VkPipeline handle = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreateGraphicsPipelines(s_ctx.device, s_ctx.pipelineCache, 1, &pipelineInfo, nullptr, &handle));
+    return handle;
+}
+
+static void CompileGraphicsPipeline(Pipeline* pipeline, const GraphicsPipelineDesc& desc)
+{
+    GraphicsPipelineState state;
+    InitGraphicsPipelineState(state, desc);
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &state.renderingInfo;
+    pipelineInfo.stageCount = state.stageCount;
+    pipelineInfo.pStages = state.stages;
+    // Mesh shaders emit primitives themselves, there is no vertex input or input assembly
+    pipelineInfo.pVertexInputState = desc.meshShader == nullptr ? &state.vertexInputState : nullptr;
+    pipelineInfo.pInputAssemblyState = desc.meshShader == nullptr ? &state.inputAssemblyState : nullptr;
+    pipelineInfo.pViewportState = &state.viewportState;
+    pipelineInfo.pRasterizationState = &state.rasterizationState;
+    pipelineInfo.pMultisampleState = &state.multisampleState;
+    pipelineInfo.pDepthStencilState = &state.depthStencilState;
+    pipelineInfo.pColorBlendState = &state.colorBlendState;
+    pipelineInfo.pDynamicState = &state.dynamicState;
+    pipelineInfo.layout = pipeline->layout;
+    VK_ASSERT(vkCreateGraphicsPipelines(s_ctx.device, s_ctx.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline->handle));
+}
+
+// Creates linked shader objects against the pipeline layout and captures the state set on bind
+static void CreateShaderObjects(Pipeline* pipeline, const GraphicsPipelineDesc& desc)
+{
+    assert(desc.colorFormats.size() <= MAX_COLOR_ATTACHMENT_COUNT);
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = pipeline->pushConstantStages;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pipeline->pushConstantSize;
+
+    const Shader* shaders[] = {desc.vertexShader, desc.fragmentShader};
+    VkShaderCreateInfoEXT shaderInfos[2] = {};
+    uint32_t shaderCount = 0;
+    for (const Shader* shader : shaders)
+    {
+        if (shader == nullptr)
+        {
+            continue;
+        }
+
+        VkShaderCreateInfoEXT& shaderInfo = shaderInfos[shaderCount];
+        shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+        shaderInfo.flags = desc.fragmentShader != nullptr ? VK_SHADER_CREATE_LINK_STAGE_BIT_EXT : 0;
+        shaderInfo.stage = shader->stage;
+        shaderInfo.nextStage = shader->stage == VK_SHADER_STAGE_VERTEX_BIT && desc.fragmentShader != nullptr ? VK_SHADER_STAGE_FRAGMENT_BIT : 0;
+        shaderInfo.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+        shaderInfo.codeSize = shader->spirv.size() * sizeof(uint32_t);
+        shaderInfo.pCode = shader->spirv.data();
+        shaderInfo.pName = shader->entryPoint.c_str();
+        shaderInfo.setLayoutCount = pipeline->descriptorSetCount;
+        shaderInfo.pSetLayouts = pipeline->descriptorSetLayouts;
+        shaderInfo.pushConstantRangeCount = pipeline->pushConstantSize > 0 ? 1 : 0;
+        shaderInfo.pPushConstantRanges = &pushConstantRange;
+        pipeline->shaderObjectStages[shaderCount] = shader->stage;
+        ++shaderCount;
+    }
+
+    VK_ASSERT(vkCreateShadersEXT(s_ctx.device, shaderCount, shaderInfos, nullptr, pipeline->shaderObjects));
+    pipeline->shaderObjectCount = shaderCount;
+    pipeline->topology = desc.topology;
+    pipeline->cullMode = desc.cullMode;
+    pipeline->depthTest = desc.depthTest;
+    pipeline->depthWrite = desc.depthWrite;
+    pipeline->colorAttachmentCount = (uint32_t)desc.colorFormats.size();
+    pipeline->vertexStride = desc.vertexStride;
+    pipeline->vertexAttributeCount = (uint32_t)desc.vertexAttributes.size();
+    std::copy(desc.vertexAttributes.begin(), desc.vertexAttributes.end(), pipeline->vertexAttributes);
+}
+
+// Libraries only pay off when the optimized link can run in the background
+static bool UseGraphicsPipelineLibrary()
+{
+    return s_ctx.graphicsPipelineLibraryFeatures.graphicsPipelineLibrary && jobsystem::GetThreadCount() > 1;
+}
+
+static void EnqueuePipeline(PipelineCompileRequest&& request, const Pipeline* fallback);
+static void ResetSplitBarriers(uint32_t frameIndex);
+
+// Records the build time, then publishes the state as the last write: once the state leaves
+// PIPELINE_STATE_COMPILING and PIPELINE_STATE_OPTIMIZING, DestroyPipeline may free the pipeline.
+static void FinishPipeline(Pipeline* pipeline, std::chrono::steady_clock::time_point start, PipelineState state)
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    pipeline->compileTimeNs += elapsed.count();
+    s_compiler.compileCount.fetch_add(1, std::memory_order_relaxed);
+    s_compiler.compileTimeNs.fetch_add(elapsed.count(), std::memory_order_relaxed);
+    pipeline->state.store(state, std::memory_order_release);
+}
+
+static void CompilePipeline(PipelineCompileRequest& request)
+{
+    auto start = std::chrono::steady_clock::now();
+    Pipeline* pipeline = request.pipeline;
+    if (pipeline->bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE)
+    {
+        CompileComputePipeline(pipeline, request.computeShader);
+        FinishPipeline(pipeline, start, PIPELINE_STATE_READY);
+        return;
+    }
+
+    request.graphicsDesc.colorFormats = request.colorFormats;
+    request.graphicsDesc.vertexAttributes = request.vertexAttributes;
+    bool meshPipeline = request.graphicsDesc.meshShader != nullptr;
+    if (request.graphicsDesc.shaderObjects && s_ctx.shaderObjectFeatures.shaderObject && !meshPipeline)
+    {
+        CreateShaderObjects(pipeline, request.graphicsDesc);
+        FinishPipeline(pipeline, start, PIPELINE_STATE_READY);
+        return;
+    }
+
+    if (!UseGraphicsPipelineLibrary() || meshPipeline)
+    {
+        CompileGraphicsPipeline(pipeline, request.graphicsDesc);
+        FinishPipeline(pipeline, start, PIPELINE_STATE_READY);
+        return;
+    }
+
+    if (request.linkTimeOptimization)
+    {
+        // Swapped in on the recording thread at the start of the next frame
+        VkPipeline optimized = LinkGraphicsPipeline(pipeline, request.graphicsDesc, true);
+        {
+            std::lock_guard<std::mutex> lock(s_compiler.lock);
+            s_compiler.optimized.push_back({pipeline, optimized});
+        }
+        FinishPipeline(pipeline, start, PIPELINE_STATE_READY);
+        return;
+    }
+
+    // Usable right away, and optimizing until the relink finishes, so DestroyPipeline waits for the relink
+    // instead of freeing the pipeline before it is queued
+    pipeline->handle = LinkGraphicsPipeline(pipeline, request.graphicsDesc, false);
+    FinishPipeline(pipeline, start, PIPELINE_STATE_OPTIMIZING);
+
+    request.linkTimeOptimization = true;
+    EnqueuePipeline(std::move(request), pipeline->fallback);
+}
+
+// Compiles whichever pending pipeline was most recently requested by a bind, not necessarily the one
+// that scheduled this job. Every request schedules exactly one job, so nothing is left behind.
+static void CompileNextPipeline()
+{
+    PipelineCompileRequest request;
+    {
+        std::lock_guard<std::mutex> lock(s_compiler.lock);
+        if (s_compiler.pending.empty())
+        {
+            return;
+        }
+
+        auto it = std::max_element(s_compiler.pending.begin(), s_compiler.pending.end(),
+                                   [](const PipelineCompileRequest& a, const PipelineCompileRequest& b)
+                                   {
+                                       uint64_t aFrame = a.pipeline->lastRequestFrame.load(std::memory_order_relaxed);
+                                       uint64_t bFrame = b.pipeline->lastRequestFrame.load(std::memory_order_relaxed);
+                                       return aFrame < bFrame || (aFrame == bFrame && a.sequence > b.sequence);
+                                   });
+        request = std::move(*it);
+        *it = std::move(s_compiler.pending.back());
+        s_compiler.pending.pop_back();
+        request.pipeline->state.store(request.linkTimeOptimization ? PIPELINE_STATE_OPTIMIZING : PIPELINE_STATE_COMPILING, std::memory_order_relaxed);
+    }
+
+    CompilePipeline(request);
+}
+
+static void EnqueuePipeline(PipelineCompileRequest&& request, const Pipeline* fallback)
+{
+    Pipeline* pipeline = request.pipeline;
+    pipeline->fallback = fallback;
+
+    // Without a worker thread, queued compiles would only run when someone waits on them
+    if (jobsystem::GetThreadCount() <= 1)
+    {
+        CompilePipeline(request);
+        return;
+    }
+
+    if (!request.linkTimeOptimization)
+    {
+        pipeline->lastRequestFrame.store(0, std::memory_order_relaxed);
+        pipeline->state.store(PIPELINE_STATE_PENDING, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_compiler.lock);
+        request.sequence = s_compiler.sequence++;
+        s_compiler.pending.push_back(std::move(request));
+    }
+    jobsystem::Execute(s_compiler.counter, [](jobsystem::JobArgs) { CompileNextPipeline(); });
+}
+
+Pipeline* CreateComputePipeline(const Shader* computeShader)
+{
+    assert(computeShader->stage == VK_SHADER_STAGE_COMPUTE_BIT);
+
+    Pipeline* pipeline = CreatePipelineLayout(VK_PIPELINE_BIND_POINT_COMPUTE, std::span(&computeShader, 1));
+    CompileComputePipeline(pipeline, computeShader);
+    pipeline->state.store(PIPELINE_STATE_READY, std::memory_order_relaxed);
+    return pipeline;
+}
+
+static void RecordPipelineState(const GraphicsPipelineDesc& desc)
+{
+    std::lock_guard<std::mutex> lock(s_recorder.lock);
+    if (!s_recorder.active)
+    {
+        return;
+    }
+
+    PipelineStateRecord record = {};
+    record.key = GetPipelineStateKey(desc);
+    record.firstFrame = s_ctx.frameCount;
+    if (s_recorder.indices.emplace(HashPipelineState(record.key), s_recorder.records.size()).second)
+    {
+        s_recorder.records.push_back(record);
+    }
+}
+
+Pipeline* CreateGraphicsPipeline(const GraphicsPipelineDesc& desc)
+{
+    assert(desc.meshShader == nullptr || IsMeshShaderSupported());
+    RecordPipelineState(desc);
+
+    PipelineCompileRequest request;
+    request.pipeline = CreatePipelineLayout(VK_PIPELINE_BIND_POINT_GRAPHICS, GetGraphicsShaders(desc));
+    request.graphicsDesc = desc;
+    request.colorFormats.assign(desc.colorFormats.begin(), desc.colorFormats.end());
+    request.vertexAttributes.assign(desc.vertexAttributes.begin(), desc.vertexAttributes.end());
+    CompilePipeline(request);
+    return request.pipeline;
+}
+
+Pipeline* CreateComputePipelineAsync(const Shader* computeShader, const Pipeline* fallback)
+{
+    assert(computeShader->stage == VK_SHADER_STAGE_COMPUTE_BIT);
+
+    PipelineCompileRequest request;
+    request.pipeline = CreatePipelineLayout(VK_PIPELINE_BIND_POINT_COMPUTE, std::span(&computeShader, 1));
+    request.computeShader = computeShader;
+    Pipeline* pipeline = request.pipeline;
+    EnqueuePipeline(std::move(request), fallback);
+    return pipeline;
+}
+
+Pipeline* CreateGraphicsPipelineAsync(const GraphicsPipelineDesc& desc, const Pipeline* fallback)
+{
+    assert(desc.meshShader == nullptr || IsMeshShaderSupported());
+    RecordPipelineState(desc);
+
+    PipelineCompileRequest request;
+    request.pipeline = CreatePipelineLayout(VK_PIPELINE_BIND_POINT_GRAPHICS, GetGraphicsShaders(desc));
+    request.graphicsDesc = desc;
+    request.colorFormats.assign(desc.colorFormats.begin(), desc.colorFormats.end());
+    request.vertexAttributes.assign(desc.vertexAttributes.begin(), desc.vertexAttributes.end());
+    Pipeline* pipeline = request.pipeline;
+    EnqueuePipeline(std::move(request), fallback);
+    return pipeline;
+}
+
+bool IsPipelineReady(const Pipeline* pipeline)
+{
+    return pipeline->state.load(std::memory_order_acquire) >= PIPELINE_STATE_READY;
+}
+
+void DestroyPipeline(Pipeline* pipeline)
+{
+    if (pipeline == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(s_compiler.lock);
+        auto it = std::find_if(s_compiler.pending.begin(), s_compiler.pending.end(),
+                               [&](const PipelineCompileRequest& request) { return request.pipeline == pipeline; });
+        bool queued = it != s_compiler.pending.end();
+        if (queued)
+        {
+            // Never started, its job will find nothing to do
+            *it = std::move(s_compiler.pending.back());
+            s_compiler.pending.pop_back();
+        }
+        lock.unlock();
+
+        // A queued relink leaves the state optimizing, nothing else is building the pipeline then
+        uint32_t state = pipeline->state.load(std::memory_order_acquire);
+        while (!queued && (state == PIPELINE_STATE_COMPILING || state == PIPELINE_STATE_OPTIMIZING))
+        {
+            std::this_thread::yield();
+            state = pipeline->state.load(std::memory_order_acquire);
+        }
+
+        lock.lock();
+        for (size_t i = 0; i < s_compiler.optimized.size(); ++i)
+        {
+            if (s_compiler.optimized[i].first == pipeline)
+            {
+                s_resMgr.destroyerPipelines.push_back({s_compiler.optimized[i].second, s_resMgr.frameCount});
+                s_compiler.optimized[i] = s_compiler.optimized.back();
+                s_compiler.optimized.pop_back();
+                break;
+            }
+        }
+    }
+
+    s_resMgr.destroyerPipelines.push_back({pipeline->handle, s_resMgr.frameCount});
+    for (uint32_t i = 0; i < pipeline->shaderObjectCount; ++i)
+    {
+        s_resMgr.destroyerShaderObjects.push_back({pipeline->shaderObjects[i], s_resMgr.frameCount});
+    }
+    s_resMgr.destroyerPipelineLayouts.push_back({pipeline->layout, s_resMgr.frameCount});
+    for (uint32_t set = 0; set < pipeline->descriptorSetCount; ++set)
+    {
+        s_resMgr.destroyerDescriptorSetLayouts.push_back({pipeline->descriptorSetLayouts[set], s_resMgr.frameCount});
+        if (pipeline->descriptorUpdateTemplates[set] != VK_NULL_HANDLE)
+        {
+            s_resMgr.destroyerDescriptorUpdateTemplates.push_back({pipeline->descriptorUpdateTemplates[set], s_resMgr.frameCount});
+        }
+    }
+    delete pipeline;
+}
+
+void WaitForPipelines()
+{
+    jobsystem::Wait(s_compiler.counter);
+}
+
+// Size of an open file in bytes, or -1 when it can't be seeked. Leaves the file position where it was.
+static long GetFileSize(FILE* file)
+{
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0, SEEK_END) != 0)
+    {
+        return -1;
+    }
+
+    long size = ftell(file);
+    if (fseek(file, position, SEEK_SET) != 0)
+    {
+        return -1;
+    }
+    return size;
+}
+
+bool LoadPipelineCache(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    long size = GetFileSize(file);
+    std::vector<uint8_t> data(size > 0 ? size : 0);
+    bool read = size >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+
+    if (!read)
+    {
+        LOGE("Failed to read pipeline cache %s.\n", path);
+        return false;
+    }
+
+    VkPipelineCacheCreateInfo pipelineCacheInfo = {};
+    pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheInfo.initialDataSize = data.size();
+    pipelineCacheInfo.pInitialData = data.data();
+
+    VkPipelineCache loaded = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreatePipelineCache(s_ctx.device, &pipelineCacheInfo, nullptr, &loaded));
+    VK_ASSERT(vkMergePipelineCaches(s_ctx.device, s_ctx.pipelineCache, 1, &loaded));
+    vkDestroyPipelineCache(s_ctx.device, loaded, nullptr);
+
+    LOGI("Loaded pipeline cache %s (%zu bytes).\n", path, data.size());
+    return true;
+}
+
+bool SavePipelineCache(const char* path)
+{
+    size_t size = 0;
+    VK_ASSERT(vkGetPipelineCacheData(s_ctx.device, s_ctx.pipelineCache, &size, nullptr));
+    std::vector<uint8_t> data(size);
+    VK_ASSERT(vkGetPipelineCacheData(s_ctx.device, s_ctx.pipelineCache, &size, data.data()));
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        LOGE("Failed to open %s for the pipeline cache.\n", path);
+        return false;
+    }
+
+    bool written = fwrite(data.data(), 1, size, file) == size;
+    fclose(file);
+
+    if (!written)
+    {
+        LOGE("Failed to write pipeline cache to %s.\n", path);
+    }
+    return written;
+}
+
+bool LoadPipelineStateList(const char* path, std::vector<PipelineStateRecord>& records)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    PipelineStateListHeader header = {};
+    bool read = fread(&header, sizeof(header), 1, file) == 1;
+    if (!read || header.magic != PIPELINE_STATE_LIST_MAGIC ||
+        header.version != PIPELINE_STATE_LIST_VERSION || header.recordSize != sizeof(PipelineStateRecord))
+    {
+        LOGE("%s is not a compatible pipeline state list.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    // The count comes from the file, so check the file can hold that many records before allocating them
+    long size = GetFileSize(file);
+    if (size < 0 || header.recordCount > (static_cast<uint64_t>(size) - sizeof(header)) / sizeof(PipelineStateRecord))
+    {
+        LOGE("Pipeline state list %s is truncated.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    records.resize(header.recordCount);
+    read = fread(records.data(), sizeof(PipelineStateRecord), records.size(), file) == records.size();
+    fclose(file);
+
+    if (!read)
+    {
+        LOGE("Pipeline state list %s is truncated.\n", path);
+        records.clear();
+    }
+    return read;
+}
+
+static bool WritePipelineStateList(const char* path, std::span<const PipelineStateRecord> records)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        LOGE("Failed to open %s for the pipeline state list.\n", path);
+        return false;
+    }
+
+    PipelineStateListHeader header = {};
+    header.magic = PIPELINE_STATE_LIST_MAGIC;
+    header.version = PIPELINE_STATE_LIST_VERSION;
+    header.recordCount = (uint32_t)records.size();
+    header.recordSize = sizeof(PipelineStateRecord);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(records.data(), sizeof(PipelineStateRecord), records.size(), file) == records.size();
+    fclose(file);
+
+    if (!written)
+    {
+        LOGE("Failed to write pipeline state list to %s.\n", path);
+    }
+    return written;
+}
+
+void StartPipelineStateRecording(const char* path)
+{
+    std::lock_guard<std::mutex> lock(s_recorder.lock);
+    s_recorder.active = true;
+    s_recorder.path = path;
+    s_recorder.indices.clear();
+    s_recorder.records.clear();
+}
+
+bool StopPipelineStateRecording()
+{
+    std::lock_guard<std::mutex> lock(s_recorder.lock);
+    if (!s_recorder.active)
+    {
+        return false;
+    }
+
+    s_recorder.active = false;
+    bool written = WritePipelineStateList(s_recorder.path.c_str(), s_recorder.records);
+    LOGI("Recorded %zu pipeline states to %s.\n", s_recorder.records.size(), s_recorder.path.c_str());
+    s_recorder.indices.clear();
+    s_recorder.records.clear();
+    return written;
+}
+
+GraphicsPipelineDesc GetGraphicsPipelineDesc(const PipelineStateKey& key, std::span<const Shader* const> shaders)
+{
+    GraphicsPipelineDesc desc = {};
+    for (const Shader* shader : shaders)
+    {
+        if (shader->hash == key.shaderHashes[0])
+        {
+            (shader->stage == VK_SHADER_STAGE_MESH_BIT_EXT ? desc.meshShader : desc.vertexShader) = shader;
+        }
+        if (key.shaderHashes[1] != 0 && shader->hash == key.shaderHashes[1])
+        {
+            desc.fragmentShader = shader;
+        }
+        if (key.shaderHashes[2] != 0 && shader->hash == key.shaderHashes[2])
+        {
+            desc.taskShader = shader;
+        }
+    }
+    if ((key.shaderHashes[1] != 0 && desc.fragmentShader == nullptr) ||
+        (key.shaderHashes[2] != 0 && (desc.taskShader == nullptr || desc.meshShader == nullptr)))
+    {
+        desc.vertexShader = nullptr;
+        desc.meshShader = nullptr;
+    }
+
+    desc.colorFormats = std::span(key.colorFormats, key.colorFormatCount);
+    desc.depthFormat = key.depthFormat;
+    desc.vertexStride = key.vertexStride;
+    desc.vertexAttributes = std::span(key.vertexAttributes, key.vertexAttributeCount);
+    desc.topology = key.topology;
+    desc.cullMode = key.cullMode;
+    desc.depthTest = key.depthTest;
+    desc.depthWrite = key.depthWrite;
+    desc.shaderObjects = key.shaderObjects;
+    return desc;
+}
+
+uint32_t ReplayPipelineStateList(const char* path, std::span<const Shader* const> shaders)
+{
+    std::vector<PipelineStateRecord> records;
+    if (!LoadPipelineStateList(path, records))
+    {
+        return 0;
+    }
+
+    // The compile queue is first come first served, so enqueueing in first use order compiles in that order
+    std::stable_sort(records.begin(), records.end(),
+                     [](const PipelineStateRecord& a, const PipelineStateRecord& b) { return a.firstFrame < b.firstFrame; });
+
+    uint32_t replayed = 0;
+    for (const PipelineStateRecord& record : records)
+    {
+        GraphicsPipelineDesc desc = GetGraphicsPipelineDesc(record.key, shaders);
+        if (desc.meshShader != nullptr && !IsMeshShaderSupported())
+        {
+            continue;
+        }
+        if (desc.vertexShader != nullptr || desc.meshShader != nullptr)
+        {
+            GetGraphicsPipeline(desc);
+            ++replayed;
+        }
+    }
+
+    LOGI("Replaying %u of %zu pipeline states from %s.\n", replayed, records.size(), path);
+    return replayed;
+}
+
+PipelineStateKey GetPipelineStateKey(const GraphicsPipelineDesc& desc)
+{
+    assert(desc.colorFormats.size() <= MAX_COLOR_ATTACHMENT_COUNT);
+    assert(desc.vertexAttributes.size() <= MAX_VERTEX_ATTRIBUTE_COUNT);
+
+    PipelineStateKey key = {};
+    const Shader* preRasterizationShader = desc.meshShader != nullptr ? desc.meshShader : desc.vertexShader;
+    key.shaderHashes[0] = preRasterizationShader != nullptr ? preRasterizationShader->hash : 0;
+    key.shaderHashes[1] = desc.fragmentShader != nullptr ? desc.fragmentShader->hash : 0;
+    key.shaderHashes[2] = desc.meshShader != nullptr && desc.taskShader != nullptr ? desc.taskShader->hash : 0;
+    std::copy(desc.colorFormats.begin(), desc.colorFormats.end(), key.colorFormats);
+    key.colorFormatCount = (uint32_t)desc.colorFormats.size();
+    key.depthFormat = desc.depthFormat;
+    key.vertexStride = desc.vertexStride;
+    std::copy(desc.vertexAttributes.begin(), desc.vertexAttributes.end(), key.vertexAttributes);
+    key.vertexAttributeCount = (uint32_t)desc.vertexAttributes.size();
+    key.topology = desc.topology;
+    key.cullMode = desc.cullMode;
+    key.depthTest = desc.depthTest;
+    key.depthWrite = desc.depthWrite;
+    key.shaderObjects = desc.shaderObjects;
+    return key;
+}
+
+uint64_t HashPipelineState(const PipelineStateKey& key)
+{
+    return Hash(&key, sizeof(key));
+}
+
+static Pipeline* FindPipeline(const PipelineMapTable* table, uint64_t hash, const PipelineStateKey& key)
+{
+    if (table == nullptr)
+    {
+        return nullptr;
+    }
+
+    for (uint32_t i = hash & (table->capacity - 1);; i = (i + 1) & (table->capacity - 1))
+    {
+        const PipelineMapTable::Slot& slot = table->slots[i];
+        uint64_t slotHash = slot.hash.load(std::memory_order_acquire);
+        if (slotHash == 0)
+        {
+            return nullptr;
+        }
+        if (slotHash == hash && memcmp(&slot.key, &key, sizeof(key)) == 0)
+        {
+            return slot.pipeline;
+        }
+    }
+}
+
+static void InsertPipeline(PipelineMapTable* table, uint64_t hash, const PipelineStateKey& key, Pipeline* pipeline)
+{
+    uint32_t i = hash & (table->capacity - 1);
+    while (table->slots[i].hash.load(std::memory_order_relaxed) != 0)
+    {
+        i = (i + 1) & (table->capacity - 1);
+    }
+
+    PipelineMapTable::Slot& slot = table->slots[i];
+    slot.key = key;
+    slot.pipeline = pipeline;
+    slot.hash.store(hash, std::memory_order_release);
+}
+
+const Pipeline* GetGraphicsPipeline(const GraphicsPipelineDesc& desc, const Pipeline* fallback)
+{
+    PipelineStateKey key = GetPipelineStateKey(desc);
+    // Zero marks an empty slot
+    uint64_t hash = std::max<uint64_t>(HashPipelineState(key), 1);
+
+    if (const Pipeline* pipeline = FindPipeline(s_pipelineMap.table.load(std::memory_order_acquire), hash, key))
+    {
+        s_pipelineMap.hitCount.fetch_add(1, std::memory_order_relaxed);
+        return pipeline;
+    }
+
+    // Created outside the lock, a compile running inline must not stall every other lookup
+    Pipeline* created = CreateGraphicsPipelineAsync(desc, fallback);
+
+    std::lock_guard<std::mutex> lock(s_pipelineMap.lock);
+    PipelineMapTable* table = s_pipelineMap.table.load(std::memory_order_relaxed);
+    // Another thread may have inserted it since the lookup, its pipeline wins
+    if (const Pipeline* pipeline = FindPipeline(table, hash, key))
+    {
+        s_pipelineMap.discarded.push_back(created);
+        s_pipelineMap.hitCount.fetch_add(1, std::memory_order_relaxed);
+        return pipeline;
+    }
+    s_pipelineMap.missCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Stay at most half full so probes remain short
+    if (table == nullptr || (s_pipelineMap.count + 1) * 2 > table->capacity)
+    {
+        auto grown = std::make_unique<PipelineMapTable>();
+        grown->capacity = table != nullptr ? table->capacity * 2 : MIN_PIPELINE_MAP_CAPACITY;
+        grown->slots = std::make_unique<PipelineMapTable::Slot[]>(grown->capacity);
+        for (uint32_t i = 0; table != nullptr && i < table->capacity; ++i)
+        {
+            const PipelineMapTable::Slot& slot = table->slots[i];
+            uint64_t slotHash = slot.hash.load(std::memory_order_relaxed);
+            if (slotHash != 0)
+            {
+                InsertPipeline(grown.get(), slotHash, slot.key, slot.pipeline);
+            }
+        }
+
+        table = grown.get();
+        s_pipelineMap.tables.push_back(std::move(grown));
+        s_pipelineMap.table.store(table, std::memory_order_release);
+    }
+
+    InsertPipeline(table, hash, key, created);
+    ++s_pipelineMap.count;
+    return created;
+}
+
+PipelineCacheStats GetPipelineCacheStats()
+{
+    PipelineCacheStats stats = {};
+    stats.hitCount = s_pipelineMap.hitCount.load(std::memory_order_relaxed);
+    stats.missCount = s_pipelineMap.missCount.load(std::memory_order_relaxed);
+    stats.compileCount = s_compiler.compileCount.load(std::memory_order_relaxed);
+    stats.compileTimeNs = s_compiler.compileTimeNs.load(std::memory_order_relaxed);
+    return stats;
 }
 
 CommandBuffer* GetCmdBuffer(QueueType queueType)
@@ -470,11 +2813,56 @@ CommandBuffer* GetCmdBuffer(QueueType queueType)
     return &frame.pools[queueType].commandBuffers[frame.pools[queueType].cmdIdx];
 }
 
+// Pending barriers count as work, the tracked states already assume them
+static bool HasRecordedWork(CommandPool& pool)
+{
+    for (uint32_t i = 0; i <= pool.cmdIdx; ++i)
+    {
+        FlushBarriers(&pool.commandBuffers[i]);
+        if (pool.commandBuffers[i].recorded)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static VkSemaphoreSubmitInfo GetSemaphoreSubmitInfo(VkSemaphore semaphore, VkPipelineStageFlags2 stages, uint64_t value)
+{
+    VkSemaphoreSubmitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    info.semaphore = semaphore;
+    info.value = value;
+    info.stageMask = stages;
+    return info;
+}
+
+void AddSubmitWait(QueueType queueType, VkSemaphore semaphore, VkPipelineStageFlags2 stages, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(s_submit.lock);
+    s_submit.batches[queueType].waits.push_back(GetSemaphoreSubmitInfo(semaphore, stages, value));
+}
+
+void AddSubmitSignal(QueueType queueType, VkSemaphore semaphore, VkPipelineStageFlags2 stages, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(s_submit.lock);
+    s_submit.batches[queueType].signals.push_back(GetSemaphoreSubmitInfo(semaphore, stages, value));
+}
+
 void NextCmdBuffer(QueueType queueType)
 {
     Frame& frame = GetFrame();
-    assert(frame.pools[queueType].cmdIdx < MAX_CMD_BUFFER_COUNT);
-    frame.pools[queueType].cmdIdx++;
+    CommandPool& pool = frame.pools[queueType];
+    assert(pool.cmdIdx + 1 < MAX_CMD_BUFFER_COUNT);
+    FlushBarriers(GetCmdBuffer(queueType));
+    pool.cmdIdx++;
+    BeginCmdBuffer(pool.commandBuffers[pool.cmdIdx]);
+}
+
+void SetSubmitIdleQueues(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(s_submit.lock);
+    s_submit.submitIdleQueues = enabled;
 }
 
 void Submit()
@@ -483,57 +2871,79 @@ void Submit()
     {
         Frame& frame = GetFrame();
 
-        auto submitQueue = [&](QueueType queueType,
-                               std::span<VkSemaphore> signalSemaphores = {},
-                               std::span<VkSemaphore> waitSemaphores = {},
-                               std::span<VkPipelineStageFlags> waitStages = {})
+        // Host writes are visible to the queue once submitted, only non-coherent memory needs the flush
+        VkDeviceSize transientBytes = s_transient.head.load(std::memory_order_relaxed);
+        if (transientBytes > 0)
         {
-            CommandPool& pool = frame.pools[queueType];
-            VkCommandBuffer cmdBuffers[MAX_CMD_BUFFER_COUNT];
-            uint32_t cmdCount = pool.cmdIdx + 1;
-
-            for (uint32_t i = 0; i < cmdCount; ++i)
-            {
-                cmdBuffers[i] = pool.commandBuffers[i].handle;
-                vkEndCommandBuffer(cmdBuffers[i]);
-            }
-
-            VkSubmitInfo submitInfo = {};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.commandBufferCount = cmdCount;
-            submitInfo.pCommandBuffers = cmdBuffers;
+            VK_ASSERT(vmaFlushAllocation(s_ctx.allocator, s_transient.buffers[GetFrameIndex()]->allocation, 0, transientBytes));
+        }
 
-            if (!signalSemaphores.empty())
-            {
-                submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
-                submitInfo.pSignalSemaphores = signalSemaphores.data();
-            }
+        // One vkQueueSubmit2 per queue, carrying every command buffer and semaphore of the frame
+        auto submitQueue = [&](QueueType queueType, VkFence fence)
+        {
+            CommandPool& pool = frame.pools[queueType];
+            SubmitBatch& batch = s_submit.batches[queueType];
 
-            if (!waitSemaphores.empty())
+            VkCommandBufferSubmitInfo cmdInfos[MAX_CMD_BUFFER_COUNT];
+            uint32_t cmdCount = 0;
+            for (uint32_t i = 0; i <= pool.cmdIdx; ++i)
             {
-                submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
-                submitInfo.pWaitSemaphores = waitSemaphores.data();
-                submitInfo.pWaitDstStageMask = waitStages.data();
+                CommandBuffer& cmd = pool.commandBuffers[i];
+                FlushBarriers(&cmd);
+                if (!cmd.recorded && !s_submit.submitIdleQueues)
+                {
+                    // Left recording, the pool reset at the frame's retirement discards it
+                    continue;
+                }
+                cmd.recorded = false;
+                VK_ASSERT(vkEndCommandBuffer(cmd.handle));
+
+                VkCommandBufferSubmitInfo& cmdInfo = cmdInfos[cmdCount++];
+                cmdInfo = {};
+                cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+                cmdInfo.commandBuffer = cmd.handle;
             }
 
-            VK_ASSERT(vkQueueSubmit(s_ctx.queues[queueType], 1, &submitInfo, VK_NULL_HANDLE));
+            VkSubmitInfo2 submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+            submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(batch.waits.size());
+            submitInfo.pWaitSemaphoreInfos = batch.waits.data();
+            submitInfo.commandBufferInfoCount = cmdCount;
+            submitInfo.pCommandBufferInfos = cmdInfos;
+            submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(batch.signals.size());
+            submitInfo.pSignalSemaphoreInfos = batch.signals.data();
+            VK_ASSERT(vkQueueSubmit2(s_ctx.queues[queueType], 1, &submitInfo, fence));
+
+            batch.waits.clear();
+            batch.signals.clear();
         };
 
-        submitQueue(QUEUE_COPY, std::span(&frame.copySemaphore, 1));
+        std::lock_guard<std::mutex> lock(s_submit.lock);
+
+        // A copy queue without work is skipped, and graphics must not wait on a semaphore nothing signals
+        const SubmitBatch& copyBatch = s_submit.batches[QUEUE_COPY];
+        bool copyWork = HasRecordedWork(frame.pools[QUEUE_COPY]);
+        if (copyWork || !copyBatch.waits.empty() || !copyBatch.signals.empty() || s_submit.submitIdleQueues)
+        {
+            // Uploads may be consumed by any graphics stage
+            s_submit.batches[QUEUE_COPY].signals.push_back(GetSemaphoreSubmitInfo(frame.copySemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0));
+            s_submit.batches[QUEUE_GRAPHICS].waits.push_back(GetSemaphoreSubmitInfo(frame.copySemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0));
+            submitQueue(QUEUE_COPY, VK_NULL_HANDLE);
+        }
 
-        uint32_t gfxWaitSemaphoreCount = 0;
-        VkSemaphore gfxWaitSemaphores[2];
-        VkPipelineStageFlags gfxWaitStages[2];
+        CommandPool& graphicsPool = frame.pools[QUEUE_GRAPHICS];
+        if (copyWork || HasRecordedWork(graphicsPool))
         {
-            gfxWaitSemaphores[0] = frame.copySemaphore;
-            gfxWaitStages[0] = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            gfxWaitSemaphoreCount++;
+            // Readbacks of this frame become visible to the host once its fence is waited
+            CmdMemoryBarrier(&graphicsPool.commandBuffers[graphicsPool.cmdIdx],
+                             VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+                             VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
         }
-        submitQueue(
-            QUEUE_GRAPHICS,
-            std::span(&frame.releaseSemaphore, 1),
-            std::span(gfxWaitSemaphores, gfxWaitSemaphoreCount),
-            std::span(gfxWaitStages, gfxWaitSemaphoreCount));
+
+        // Always submitted, the fence marks the frame as retired
+        s_submit.batches[QUEUE_GRAPHICS].signals.push_back(GetSemaphoreSubmitInfo(frame.releaseSemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0));
+        s_submit.batches[QUEUE_GRAPHICS].signals.push_back(GetSemaphoreSubmitInfo(s_ctx.graphicsTimeline, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, s_ctx.frameCount + 1));
+        submitQueue(QUEUE_GRAPHICS, frame.fence);
     }
 
     s_ctx.frameCount++;
@@ -547,20 +2957,610 @@ void Submit()
             VK_ASSERT(vkWaitForFences(s_ctx.device, 1, &frame.fence, true, UINT64_MAX));
             VK_ASSERT(vkResetFences(s_ctx.device, 1, &frame.fence));
 
+            ResetDescriptorAllocators(frame);
+            ReleaseStaging(s_ctx.frameCount);
+            ResetSplitBarriers(GetFrameIndex());
+
             for (uint32_t i = 0; i < MAX_QUEUE_COUNT; ++i)
             {
                 CommandPool& pool = frame.pools[i];
                 pool.cmdIdx = 0;
 
                 VK_ASSERT(vkResetCommandPool(s_ctx.device, pool.handle, 0));
+                for (CommandBuffer& cmd : pool.commandBuffers)
+                {
+                    cmd.pipeline = nullptr;
+                }
 
-                VkCommandBufferBeginInfo cmdBeginInfo = {};
-                cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-                cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-                cmdBeginInfo.pInheritanceInfo = nullptr;
-                VK_ASSERT(vkBeginCommandBuffer(pool.commandBuffers[0].handle, &cmdBeginInfo));
+                BeginCmdBuffer(pool.commandBuffers[0]);
             }
         }
+
+        // This frame's transient buffer was last read by the frame whose fence was just waited
+        s_transient.head.store(0, std::memory_order_relaxed);
+
+        s_resMgr.Update(s_ctx.device, s_ctx.allocator, s_ctx.frameCount, MAX_FRAMES_IN_FLIGHT);
+        UpdateDefragmentation();
+        DestroyDiscardedPipelines();
+        ApplyOptimizedPipelines();
+    }
+}
+
+// Shader objects carry no state, so everything a pipeline would bake in is set here
+static void BindShaderObjects(CommandBuffer* cmd, const Pipeline* pipeline)
+{
+    VkCommandBuffer handle = cmd->handle;
+
+    // Every graphics stage the device enables must be bound, unused ones to null
+    VkShaderStageFlagBits unusedStages[6];
+    uint32_t unusedStageCount = 0;
+    if (s_ctx.features2.features.tessellationShader)
+    {
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    }
+    if (s_ctx.features2.features.geometryShader)
+    {
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_GEOMETRY_BIT;
+    }
+    if (s_ctx.meshShaderFeatures.taskShader)
+    {
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_TASK_BIT_EXT;
+    }
+    if (s_ctx.meshShaderFeatures.meshShader)
+    {
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+    if (pipeline->shaderObjectCount == 1)
+    {
+        unusedStages[unusedStageCount++] = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    if (unusedStageCount > 0)
+    {
+        vkCmdBindShadersEXT(handle, unusedStageCount, unusedStages, nullptr);
+    }
+    vkCmdBindShadersEXT(handle, pipeline->shaderObjectCount, pipeline->shaderObjectStages, pipeline->shaderObjects);
+
+    VkVertexInputBindingDescription2EXT vertexBinding = {};
+    vertexBinding.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+    vertexBinding.binding = 0;
+    vertexBinding.stride = pipeline->vertexStride;
+    vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vertexBinding.divisor = 1;
+    VkVertexInputAttributeDescription2EXT vertexAttributes[MAX_VERTEX_ATTRIBUTE_COUNT];
+    for (uint32_t i = 0; i < pipeline->vertexAttributeCount; ++i)
+    {
+        vertexAttributes[i] = {};
+        vertexAttributes[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+        vertexAttributes[i].location = pipeline->vertexAttributes[i].location;
+        vertexAttributes[i].binding = pipeline->vertexAttributes[i].binding;
+        vertexAttributes[i].format = pipeline->vertexAttributes[i].format;
+        vertexAttributes[i].offset = pipeline->vertexAttributes[i].offset;
+    }
+    vkCmdSetVertexInputEXT(handle, pipeline->vertexStride > 0 ? 1 : 0, &vertexBinding, pipeline->vertexAttributeCount, vertexAttributes);
+    vkCmdSetPrimitiveTopology(handle, pipeline->topology);
+    vkCmdSetPrimitiveRestartEnable(handle, VK_FALSE);
+
+    vkCmdSetRasterizerDiscardEnable(handle, VK_FALSE);
+    vkCmdSetPolygonModeEXT(handle, VK_POLYGON_MODE_FILL);
+    vkCmdSetCullMode(handle, pipeline->cullMode);
+    vkCmdSetFrontFace(handle, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+    vkCmdSetDepthBiasEnable(handle, VK_FALSE);
+    vkCmdSetLineWidth(handle, 1.0f);
+    if (s_ctx.features2.features.depthClamp)
+    {
+        vkCmdSetDepthClampEnableEXT(handle, VK_FALSE);
+    }
+
+    VkSampleMask sampleMask = ~0u;
+    vkCmdSetRasterizationSamplesEXT(handle, VK_SAMPLE_COUNT_1_BIT);
+    vkCmdSetSampleMaskEXT(handle, VK_SAMPLE_COUNT_1_BIT, &sampleMask);
+    vkCmdSetAlphaToCoverageEnableEXT(handle, VK_FALSE);
+    if (s_ctx.features2.features.alphaToOne)
+    {
+        vkCmdSetAlphaToOneEnableEXT(handle, VK_FALSE);
+    }
+
+    vkCmdSetDepthTestEnable(handle, pipeline->depthTest);
+    vkCmdSetDepthWriteEnable(handle, pipeline->depthWrite);
+    vkCmdSetDepthCompareOp(handle, VK_COMPARE_OP_LESS_OR_EQUAL);
+    vkCmdSetStencilTestEnable(handle, VK_FALSE);
+    if (s_ctx.features2.features.depthBounds)
+    {
+        vkCmdSetDepthBoundsTestEnable(handle, VK_FALSE);
+    }
+
+    if (s_ctx.features2.features.logicOp)
+    {
+        vkCmdSetLogicOpEnableEXT(handle, VK_FALSE);
+    }
+    if (pipeline->colorAttachmentCount > 0)
+    {
+        VkBool32 blendEnables[MAX_COLOR_ATTACHMENT_COUNT] = {};
+        VkColorComponentFlags writeMasks[MAX_COLOR_ATTACHMENT_COUNT];
+        std::fill_n(writeMasks, pipeline->colorAttachmentCount,
+                    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT);
+        vkCmdSetColorBlendEnableEXT(handle, 0, pipeline->colorAttachmentCount, blendEnables);
+        vkCmdSetColorWriteMaskEXT(handle, 0, pipeline->colorAttachmentCount, writeMasks);
+    }
+}
+
+bool CmdBindPipeline(CommandBuffer* cmd, const Pipeline* pipeline)
+{
+    if (!IsPipelineReady(pipeline))
+    {
+        // Used this frame, so it moves to the front of the compile queue
+        pipeline->lastRequestFrame.store(s_ctx.frameCount + 1, std::memory_order_relaxed);
+
+        pipeline = pipeline->fallback;
+        if (pipeline == nullptr || !IsPipelineReady(pipeline))
+        {
+            // Dependent commands become no-ops until a pipeline is bound
+            cmd->pipeline = nullptr;
+            return false;
+        }
+    }
+
+    cmd->pipeline = pipeline;
+    if (pipeline->shaderObjectCount > 0)
+    {
+        BindShaderObjects(cmd, pipeline);
+        return true;
+    }
+    vkCmdBindPipeline(cmd->handle, pipeline->bindPoint, LoadPipelineHandle(pipeline));
+    return true;
+}
+
+void CmdSetViewport(CommandBuffer* cmd, const VkViewport& viewport, const VkRect2D& scissor)
+{
+    vkCmdSetViewportWithCount(cmd->handle, 1, &viewport);
+    vkCmdSetScissorWithCount(cmd->handle, 1, &scissor);
+}
+
+void CmdPushConstants(CommandBuffer* cmd, const void* data, uint32_t size, uint32_t offset)
+{
+    if (cmd->pipeline == nullptr)
+    {
+        return;
+    }
+    if (offset + size > cmd->pipeline->pushConstantSize)
+    {
+        LOGE("Push constants [%u, %u) exceed the reflected range of %u bytes.\n", offset, offset + size, cmd->pipeline->pushConstantSize);
+        assert(false);
+        return;
+    }
+    vkCmdPushConstants(cmd->handle, cmd->pipeline->layout, cmd->pipeline->pushConstantStages, offset, size, data);
+}
+
+void CmdBindDescriptors(CommandBuffer* cmd, uint32_t set, std::span<const DescriptorInfo> descriptors)
+{
+    const Pipeline* pipeline = cmd->pipeline;
+    if (pipeline == nullptr)
+    {
+        return;
+    }
+    assert(set < pipeline->descriptorSetCount);
+    assert(descriptors.size() == pipeline->descriptorCounts[set]);
+
+    if (set == pipeline->pushDescriptorSet)
+    {
+        s_ctx.cmdPushDescriptorSetWithTemplate(cmd->handle, pipeline->descriptorUpdateTemplates[set], pipeline->layout, set, descriptors.data());
+        return;
+    }
+
+    VkDescriptorSet descriptorSet = AllocateDescriptorSet(pipeline->descriptorSetLayouts[set]);
+    if (descriptorSet == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    vkUpdateDescriptorSetWithTemplate(s_ctx.device, descriptorSet, pipeline->descriptorUpdateTemplates[set], descriptors.data());
+    vkCmdBindDescriptorSets(cmd->handle, pipeline->bindPoint, pipeline->layout, set, 1, &descriptorSet, 0, nullptr);
+}
+
+void CmdDispatch(CommandBuffer* cmd, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    FlushBarriers(cmd);
+    if (cmd->pipeline == nullptr)
+    {
+        return;
+    }
+    cmd->recorded = true;
+    vkCmdDispatch(cmd->handle, groupCountX, groupCountY, groupCountZ);
+}
+
+void CmdFillBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data)
+{
+    assert(IsAlive(buffer));
+    FlushBarriers(cmd);
+    cmd->recorded = true;
+    vkCmdFillBuffer(cmd->handle, buffer->handle, offset, size, data);
+}
+
+void CmdUpdateBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size, const void* data)
+{
+    assert(IsAlive(buffer));
+    FlushBarriers(cmd);
+    cmd->recorded = true;
+    vkCmdUpdateBuffer(cmd->handle, buffer->handle, offset, size, data);
+}
+
+struct ResourceUseInfo
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    // Ignored for buffers, buffer-only uses have none
+    VkImageLayout layout;
+    bool write;
+};
+
+static const ResourceUseInfo s_resourceUses[RESOURCE_USE_COUNT] = {
+    {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, false},
+    {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false},
+    {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true},
+    {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false},
+    {VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false},
+    {VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false},
+    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false},
+    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true},
+    {VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false},
+    {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true},
+    {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+     VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, true},
+    {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false},
+};
+
+struct ResourceBarrier
+{
+    VkPipelineStageFlags2 srcStages;
+    VkAccessFlags2 srcAccess;
+    VkPipelineStageFlags2 dstStages;
+    VkAccessFlags2 dstAccess;
+};
+
+// Advances the state to the use, returns false when the use needs no barrier
+static bool TrackResourceUse(ResourceState& state, const ResourceUseInfo& use, bool layoutChange, QueueType queueType, ResourceBarrier& barrier)
+{
+    barrier = {};
+    if (!use.write && !layoutChange)
+    {
+        // Read after read: nothing to do when the last write is already visible to these stages
+        if ((use.stages & ~state.readStages) == 0 && (use.access & ~state.readAccess) == 0)
+        {
+            return false;
+        }
+        barrier.srcStages = state.writeStages;
+        barrier.srcAccess = state.writeAccess;
+        state.readStages |= use.stages;
+        state.readAccess |= use.access;
+    }
+    else
+    {
+        // Write after read only waits for the reads, which already waited for the last write
+        if (state.readStages != 0)
+        {
+            barrier.srcStages = state.readStages;
+        }
+        else
+        {
+            barrier.srcStages = state.writeStages;
+            barrier.srcAccess = state.writeAccess;
+        }
+        // A layout transition writes too, later reads chain after the stages it completed before
+        state.writeStages = use.stages;
+        state.writeAccess = use.write ? use.access : VK_ACCESS_2_NONE;
+        state.readStages = use.write ? VK_PIPELINE_STAGE_2_NONE : use.stages;
+        state.readAccess = use.write ? VK_ACCESS_2_NONE : use.access;
+    }
+    barrier.dstStages = use.stages;
+    barrier.dstAccess = use.access;
+
+    // The copy queue cannot name graphics or compute stages, the semaphore between the queues orders those
+    if (queueType == QUEUE_COPY)
+    {
+        const VkPipelineStageFlags2 copyStages = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_HOST_BIT;
+        barrier.srcStages &= copyStages;
+        barrier.dstStages &= copyStages;
+        barrier.srcAccess = barrier.srcStages != 0 ? barrier.srcAccess : VK_ACCESS_2_NONE;
+        barrier.dstAccess = barrier.dstStages != 0 ? barrier.dstAccess : VK_ACCESS_2_NONE;
+    }
+    return layoutChange || (barrier.srcStages != 0 && barrier.dstStages != 0);
+}
+
+// Adds the barrier the use needs to a batch of one memory barrier and any number of image barriers
+static void AddTransition(VkMemoryBarrier2& memoryBarrier, QueueType queueType, Buffer* buffer, ResourceUse use)
+{
+    assert(IsAlive(buffer));
+    ResourceBarrier barrier;
+    if (use == RESOURCE_USE_NONE || !TrackResourceUse(buffer->state, s_resourceUses[use], false, queueType, barrier))
+    {
+        return;
+    }
+
+    memoryBarrier.srcStageMask |= barrier.srcStages;
+    memoryBarrier.srcAccessMask |= barrier.srcAccess;
+    memoryBarrier.dstStageMask |= barrier.dstStages;
+    memoryBarrier.dstAccessMask |= barrier.dstAccess;
+}
+
+static void AddTransition(std::vector<VkImageMemoryBarrier2>& imageBarriers, QueueType queueType, Texture* texture, ResourceUse use)
+{
+    assert(IsAlive(texture));
+    const ResourceUseInfo& info = s_resourceUses[use];
+    if (use == RESOURCE_USE_NONE)
+    {
+        // Contents are discarded, the next use still waits for the previous ones
+        texture->state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        return;
+    }
+    assert(info.layout != VK_IMAGE_LAYOUT_UNDEFINED && "Buffer-only use of a texture");
+
+    VkImageLayout oldLayout = texture->state.layout;
+    ResourceBarrier barrier;
+    if (!TrackResourceUse(texture->state, info, oldLayout != info.layout, queueType, barrier))
+    {
+        return;
+    }
+    texture->state.layout = info.layout;
+
+    // Barriers of one batch are unordered, so a second transition of the image extends the pending one
+    for (VkImageMemoryBarrier2& pending : imageBarriers)
+    {
+        if (pending.image == texture->handle)
+        {
+            pending.dstStageMask |= barrier.dstStages;
+            pending.dstAccessMask |= barrier.dstAccess;
+            pending.newLayout = info.layout;
+            return;
+        }
+    }
+
+    VkImageMemoryBarrier2 imageBarrier = {};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    imageBarrier.srcStageMask = barrier.srcStages;
+    imageBarrier.srcAccessMask = barrier.srcAccess;
+    imageBarrier.dstStageMask = barrier.dstStages;
+    imageBarrier.dstAccessMask = barrier.dstAccess;
+    imageBarrier.oldLayout = oldLayout;
+    imageBarrier.newLayout = info.layout;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = texture->handle;
+    imageBarrier.subresourceRange.aspectMask = IsDepthFormat(texture->format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    imageBarriers.push_back(imageBarrier);
+}
+
+// False when the batch is empty
+static bool GetDependencyInfo(VkMemoryBarrier2& memoryBarrier, std::span<const VkImageMemoryBarrier2> imageBarriers, VkDependencyInfo& dependencyInfo)
+{
+    bool hasMemoryBarrier = memoryBarrier.srcStageMask != 0 || memoryBarrier.dstStageMask != 0;
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+    dependencyInfo = {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+    dependencyInfo.pMemoryBarriers = &memoryBarrier;
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+    dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+    return hasMemoryBarrier || !imageBarriers.empty();
+}
+
+void Transition(CommandBuffer* cmd, Buffer* buffer, ResourceUse use)
+{
+    AddTransition(cmd->pendingMemoryBarrier, cmd->queueType, buffer, use);
+}
+
+void Transition(CommandBuffer* cmd, Texture* texture, ResourceUse use)
+{
+    AddTransition(cmd->pendingImageBarriers, cmd->queueType, texture, use);
+}
+
+void FlushBarriers(CommandBuffer* cmd)
+{
+    VkDependencyInfo dependencyInfo;
+    if (!GetDependencyInfo(cmd->pendingMemoryBarrier, cmd->pendingImageBarriers, dependencyInfo))
+    {
+        return;
+    }
+    cmd->recorded = true;
+    vkCmdPipelineBarrier2(cmd->handle, &dependencyInfo);
+
+    cmd->pendingMemoryBarrier = {};
+    cmd->pendingImageBarriers.clear();
+}
+
+SplitBarrier* AcquireSplitBarrier(QueueType queueType)
+{
+    std::lock_guard<std::mutex> lock(s_splitBarriers.lock);
+    std::vector<std::unique_ptr<SplitBarrier>>& barriers = s_splitBarriers.barriers[GetFrameIndex()];
+    uint32_t& count = s_splitBarriers.counts[GetFrameIndex()];
+    if (count == barriers.size())
+    {
+        VkEventCreateInfo eventInfo = {};
+        eventInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
+        barriers.push_back(std::make_unique<SplitBarrier>());
+        VK_ASSERT(vkCreateEvent(s_ctx.device, &eventInfo, nullptr, &barriers.back()->event));
+    }
+
+    SplitBarrier* barrier = barriers[count++].get();
+    barrier->queueType = queueType;
+    barrier->state = SPLIT_BARRIER_RECORDING;
+    return barrier;
+}
+
+void SplitTransition(SplitBarrier* barrier, Buffer* buffer, ResourceUse use)
+{
+    assert(barrier->state == SPLIT_BARRIER_RECORDING);
+    AddTransition(barrier->memoryBarrier, barrier->queueType, buffer, use);
+}
+
+void SplitTransition(SplitBarrier* barrier, Texture* texture, ResourceUse use)
+{
+    assert(barrier->state == SPLIT_BARRIER_RECORDING);
+    AddTransition(barrier->imageBarriers, barrier->queueType, texture, use);
+}
+
+void SignalSplitBarrier(CommandBuffer* cmd, SplitBarrier* barrier)
+{
+    assert(barrier->state == SPLIT_BARRIER_RECORDING && cmd->queueType == barrier->queueType);
+    FlushBarriers(cmd);
+    barrier->state = SPLIT_BARRIER_SIGNALED;
+
+    VkDependencyInfo dependencyInfo;
+    if (GetDependencyInfo(barrier->memoryBarrier, barrier->imageBarriers, dependencyInfo))
+    {
+        cmd->recorded = true;
+        vkCmdSetEvent2(cmd->handle, barrier->event, &dependencyInfo);
+    }
+}
+
+void WaitSplitBarrier(CommandBuffer* cmd, SplitBarrier* barrier)
+{
+    assert(barrier->state == SPLIT_BARRIER_SIGNALED && cmd->queueType == barrier->queueType);
+    FlushBarriers(cmd);
+    barrier->state = SPLIT_BARRIER_WAITED;
+
+    // Must repeat the dependency given to vkCmdSetEvent2 exactly
+    VkDependencyInfo dependencyInfo;
+    if (GetDependencyInfo(barrier->memoryBarrier, barrier->imageBarriers, dependencyInfo))
+    {
+        cmd->recorded = true;
+        vkCmdWaitEvents2(cmd->handle, 1, &barrier->event, &dependencyInfo);
+    }
+}
+
+// Called once the frame's fence was waited, every event it set has been reached
+static void ResetSplitBarriers(uint32_t frameIndex)
+{
+    std::vector<std::unique_ptr<SplitBarrier>>& barriers = s_splitBarriers.barriers[frameIndex];
+    for (uint32_t i = 0; i < s_splitBarriers.counts[frameIndex]; ++i)
+    {
+        SplitBarrier& barrier = *barriers[i];
+        assert(barrier.state != SPLIT_BARRIER_SIGNALED && "Split barrier signaled but never waited");
+        VK_ASSERT(vkResetEvent(s_ctx.device, barrier.event));
+        barrier.memoryBarrier = {};
+        barrier.imageBarriers.clear();
+        barrier.state = SPLIT_BARRIER_IDLE;
+    }
+    s_splitBarriers.counts[frameIndex] = 0;
+}
+
+void CmdMemoryBarrier(CommandBuffer* cmd, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    FlushBarriers(cmd);
+    VkMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStage;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStage;
+    barrier.dstAccessMask = dstAccess;
+
+    VkDependencyInfo dependencyInfo = {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+    cmd->recorded = true;
+    vkCmdPipelineBarrier2(cmd->handle, &dependencyInfo);
+}
+
+void CmdTextureBarrier(CommandBuffer* cmd,
+                       const Texture* texture,
+                       VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+                       VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess,
+                       VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    assert(IsAlive(texture));
+    FlushBarriers(cmd);
+    VkImageMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStage;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStage;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = texture->handle;
+    barrier.subresourceRange.aspectMask = IsDepthFormat(texture->format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    VkDependencyInfo dependencyInfo = {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+    cmd->recorded = true;
+    vkCmdPipelineBarrier2(cmd->handle, &dependencyInfo);
+}
+
+void CmdCopyBuffer(CommandBuffer* cmd, const Buffer* srcBuffer, VkDeviceSize srcOffset, const Buffer* dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+    assert(IsAlive(srcBuffer) && IsAlive(dstBuffer));
+    FlushBarriers(cmd);
+    VkBufferCopy region = {};
+    region.srcOffset = srcOffset;
+    region.dstOffset = dstOffset;
+    region.size = size;
+    cmd->recorded = true;
+    vkCmdCopyBuffer(cmd->handle, srcBuffer->handle, dstBuffer->handle, 1, &region);
+}
+
+void CmdCopyBufferToTexture(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize bufferOffset, const Texture* texture, uint32_t mipLevel)
+{
+    assert(IsAlive(buffer) && IsAlive(texture));
+    FlushBarriers(cmd);
+    VkBufferImageCopy region = {};
+    region.bufferOffset = bufferOffset;
+    region.imageSubresource.aspectMask = IsDepthFormat(texture->format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = mipLevel;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {std::max(texture->width >> mipLevel, 1u), std::max(texture->height >> mipLevel, 1u), 1};
+    cmd->recorded = true;
+    vkCmdCopyBufferToImage(cmd->handle, buffer->handle, texture->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+void CmdBindIndexBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkIndexType indexType)
+{
+    assert(IsAlive(buffer));
+    vkCmdBindIndexBuffer(cmd->handle, buffer->handle, offset, indexType);
+}
+
+void CmdBindVertexBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset)
+{
+    assert(IsAlive(buffer));
+    vkCmdBindVertexBuffers(cmd->handle, 0, 1, &buffer->handle, &offset);
+}
+
+void CmdDrawIndexedIndirectCount(CommandBuffer* cmd,
+                                 const Buffer* argsBuffer, VkDeviceSize argsOffset,
+                                 const Buffer* countBuffer, VkDeviceSize countOffset,
+                                 uint32_t maxDrawCount)
+{
+    if (cmd->pipeline == nullptr)
+    {
+        return;
+    }
+    assert(s_ctx.features_1_2.drawIndirectCount);
+    assert(IsAlive(argsBuffer) && IsAlive(countBuffer));
+    FlushBarriers(cmd);
+    cmd->recorded = true;
+    vkCmdDrawIndexedIndirectCount(cmd->handle,
+                                  argsBuffer->handle, argsOffset,
+                                  countBuffer->handle, countOffset,
+                                  maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void CmdDrawMeshTasks(CommandBuffer* cmd, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    FlushBarriers(cmd);
+    if (cmd->pipeline == nullptr)
+    {
+        return;
     }
+    assert(IsMeshShaderSupported());
+    cmd->recorded = true;
+    vkCmdDrawMeshTasksEXT(cmd->handle, groupCountX, groupCountY, groupCountZ);
 }
-} // namespace rhi
\ No newline at end of file
+} // namespace rhi
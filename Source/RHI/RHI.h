@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Foundation/Log.h"
+#include "RHI/HandlePool.h"
 
 #ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -13,13 +14,28 @@
 
 #include <array>
 #include <algorithm>
+#include <atomic>
 #include <deque>
 #include <set>
 #include <span>
+#include <string.h>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 #define VK_DEBUG
 
+#define MAX_FRAMES_IN_FLIGHT 3
+#define MAX_DESCRIPTOR_SET_COUNT 4
+// Set reserved for small per-draw bindings, pushed instead of allocated when push descriptors are available
+#define PUSH_DESCRIPTOR_SET (MAX_DESCRIPTOR_SET_COUNT - 1)
+#define MAX_COLOR_ATTACHMENT_COUNT 8
+#define MAX_VERTEX_ATTRIBUTE_COUNT 8
+// Bytes of the shared staging ring, the largest single upload it can take
+#define STAGING_RING_SIZE (64ull << 20)
+// Bytes of each frame's transient buffer, the most transient data one frame can allocate
+#define TRANSIENT_BUFFER_SIZE (16ull << 20)
+
 #define VK_ASSERT(x)                                              \
     do                                                            \
     {                                                             \
@@ -39,33 +55,508 @@ enum QueueType
     QUEUE_COUNT = 2
 };
 
+enum MemoryCategory
+{
+    MEMORY_CATEGORY_GEOMETRY = 0,
+    MEMORY_CATEGORY_TEXTURE = 1,
+    MEMORY_CATEGORY_RENDER_TARGET = 2,
+    MEMORY_CATEGORY_STAGING = 3,
+    MEMORY_CATEGORY_ACCELERATION_STRUCTURE = 4,
+    MEMORY_CATEGORY_TRANSIENT = 5,
+    MEMORY_CATEGORY_COUNT = 6
+};
+
+struct MemoryCategoryStats
+{
+    uint64_t allocationBytes;
+    uint32_t allocationCount;
+};
+
+struct MemoryStats
+{
+    MemoryCategoryStats categories[MEMORY_CATEGORY_COUNT];
+};
+
+// How a command accesses a resource, see Transition
+enum ResourceUse
+{
+    // Nothing to wait for, images are in VK_IMAGE_LAYOUT_UNDEFINED and their contents are discarded
+    RESOURCE_USE_NONE = 0,
+    RESOURCE_USE_TRANSFER_READ = 1,
+    RESOURCE_USE_TRANSFER_WRITE = 2,
+    RESOURCE_USE_INDIRECT_READ = 3,
+    RESOURCE_USE_INDEX_READ = 4,
+    RESOURCE_USE_VERTEX_READ = 5,
+    // Sampled, uniform or storage reads
+    RESOURCE_USE_COMPUTE_READ = 6,
+    // Storage reads and writes, images in VK_IMAGE_LAYOUT_GENERAL
+    RESOURCE_USE_COMPUTE_WRITE = 7,
+    // Sampled, uniform or storage reads in any pre-rasterization or fragment shader
+    RESOURCE_USE_GRAPHICS_READ = 8,
+    RESOURCE_USE_COLOR_ATTACHMENT = 9,
+    RESOURCE_USE_DEPTH_ATTACHMENT = 10,
+    RESOURCE_USE_HOST_READ = 11,
+    RESOURCE_USE_COUNT = 12
+};
+
+// Last synchronized accesses of a resource, in recording order
+struct ResourceState
+{
+    VkPipelineStageFlags2 writeStages;
+    VkAccessFlags2 writeAccess;
+    // Reads since the last write that already wait for it
+    VkPipelineStageFlags2 readStages;
+    VkAccessFlags2 readAccess;
+    VkImageLayout layout;
+};
+
+struct Buffer;
+struct Texture;
+using BufferHandle = Handle<Buffer>;
+using TextureHandle = Handle<Texture>;
+
 struct BufferDesc
 {
     size_t size;
     VmaMemoryUsage memoryUsage;
     VkBufferUsageFlags bufferUsage;
+    MemoryCategory category = MEMORY_CATEGORY_GEOMETRY;
+    // Written by the host in place instead of through the staging ring when the device has a resizable BAR.
+    // Decided per allocation: the buffer is mapped in device-local memory, or gets memoryUsage with a null
+    // mappedData when there is no resizable BAR or its heap is full. WriteBuffer handles both.
+    // Meant for dynamic and per-frame buffers: the BAR heap is small, and mapped buffers are never defragmented.
+    bool hostWrite = false;
 };
 
+// Lives in a generational pool slot, so a destroyed Buffer* still reads an id the pool rejects
 struct Buffer
 {
+    BufferHandle id;
     VkBuffer handle;
 
     VmaAllocation allocation;
     VkDeviceAddress deviceAddress;
+    // Persistently mapped for host-visible memory usages, null otherwise
+    void* mappedData;
 
     size_t size;
     VmaMemoryUsage memoryUsage;
+    VkBufferUsageFlags bufferUsage;
+    MemoryCategory category;
+    ResourceState state;
+};
+
+struct TextureDesc
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels = 1;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    MemoryCategory category = MEMORY_CATEGORY_TEXTURE;
+};
+
+// 2D image with a view over all of its mips. Shared by the copy and graphics queues without ownership transfers.
+struct Texture
+{
+    TextureHandle id;
+    VkImage handle;
+    VkImageView view;
+
+    VmaAllocation allocation;
+    // Bytes of the allocation
+    VkDeviceSize size;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    MemoryCategory category;
+    ResourceState state;
+};
+
+struct Shader
+{
+    VkShaderModule handle;
+    uint64_t hash;
+    VkShaderStageFlagBits stage;
+    std::string entryPoint;
+
+    // Reflected push constant block, zero if the shader has none
+    uint32_t pushConstantSize;
+    // Reflected descriptor bindings, sorted by binding
+    std::vector<VkDescriptorSetLayoutBinding> descriptorBindings[MAX_DESCRIPTOR_SET_COUNT];
+    // Kept for VK_EXT_shader_object, empty when the device does not support it
+    std::vector<uint32_t> spirv;
+};
+
+// Packed descriptor data consumed by the pipeline's update templates.
+// One element per descriptor, in binding order and then array element order.
+union DescriptorInfo
+{
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo image;
+    VkBufferView texelBufferView;
+    VkAccelerationStructureKHR accelerationStructure;
+};
+
+struct GraphicsPipelineDesc
+{
+    const Shader* vertexShader;
+    const Shader* fragmentShader;
+
+    std::span<const VkFormat> colorFormats;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+    // Interleaved vertex buffer at binding 0, see VertexLayout.h. A zero stride pulls vertices from device-address buffers instead.
+    uint32_t vertexStride = 0;
+    std::span<const VkVertexInputAttributeDescription> vertexAttributes;
+
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    bool depthTest = true;
+    bool depthWrite = true;
+
+    // Binds VK_EXT_shader_object shaders and sets every state on bind instead of compiling a pipeline.
+    // Ignored when the device does not support shader objects.
+    bool shaderObjects = false;
+
+    // VK_EXT_mesh_shader stages replacing vertexShader, the task shader is optional. Requires IsMeshShaderSupported().
+    // Mesh pipelines are always compiled whole, without library parts or shader objects.
+    const Shader* taskShader = nullptr;
+    const Shader* meshShader = nullptr;
+};
+
+// Plain-data identity of a graphics pipeline: shaders by SPIR-V hash, every other state by value.
+// Has no padding, so its bytes hash the same across runs.
+struct PipelineStateKey
+{
+    // Vertex or mesh shader, fragment shader, task shader
+    uint64_t shaderHashes[3];
+    VkFormat colorFormats[MAX_COLOR_ATTACHMENT_COUNT];
+    uint32_t colorFormatCount;
+    VkFormat depthFormat;
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cullMode;
+    uint32_t depthTest;
+    uint32_t depthWrite;
+    uint32_t shaderObjects;
+    uint32_t vertexStride;
+    VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTE_COUNT];
+    uint32_t vertexAttributeCount;
+    uint32_t padding;
+};
+static_assert(std::has_unique_object_representations_v<PipelineStateKey>);
+
+// Entry of a pipeline state list file
+struct PipelineStateRecord
+{
+    PipelineStateKey key;
+    uint64_t firstFrame;
+};
+
+struct PipelineCacheStats
+{
+    uint64_t hitCount;
+    uint64_t missCount;
+    // Every compile, link and link-time optimization, cached or not
+    uint64_t compileCount;
+    uint64_t compileTimeNs;
+};
+
+enum PipelineState
+{
+    PIPELINE_STATE_PENDING = 0,
+    PIPELINE_STATE_COMPILING = 1,
+    PIPELINE_STATE_READY = 2,
+    // Ready, with a link-time optimized replacement being built in the background
+    PIPELINE_STATE_OPTIMIZING = 3
+};
+
+struct Pipeline
+{
+    // Swapped atomically once a background link-time optimized pipeline replaces it
+    alignas(std::atomic_ref<VkPipeline>::required_alignment) VkPipeline handle;
+    VkPipelineLayout layout;
+    VkPipelineBindPoint bindPoint;
+    uint64_t layoutHash;
+
+    VkShaderStageFlags pushConstantStages;
+    uint32_t pushConstantSize;
+
+    uint32_t descriptorSetCount;
+    uint32_t pushDescriptorSet;
+    VkDescriptorSetLayout descriptorSetLayouts[MAX_DESCRIPTOR_SET_COUNT];
+    VkDescriptorUpdateTemplate descriptorUpdateTemplates[MAX_DESCRIPTOR_SET_COUNT];
+    uint32_t descriptorCounts[MAX_DESCRIPTOR_SET_COUNT];
+
+    // Shader object mode: handle is null, the shaders are bound directly and the state below is set on bind
+    uint32_t shaderObjectCount;
+    VkShaderStageFlagBits shaderObjectStages[2];
+    VkShaderEXT shaderObjects[2];
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cullMode;
+    bool depthTest;
+    bool depthWrite;
+    uint32_t colorAttachmentCount;
+    uint32_t vertexStride;
+    uint32_t vertexAttributeCount;
+    VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTE_COUNT];
+
+    // Asynchronous compilation, handle is only valid once the state is PIPELINE_STATE_READY or later
+    std::atomic<uint32_t> state;
+    mutable std::atomic<uint64_t> lastRequestFrame;
+    const Pipeline* fallback;
+    // Total build time, including the background link-time optimization
+    uint64_t compileTimeNs;
+};
+
+// Region of the persistently mapped staging ring, data is null when the ring had no room
+struct StagingAllocation
+{
+    const Buffer* buffer;
+    VkDeviceSize offset;
+    void* data;
+};
+
+// Region of the current frame's transient buffer, data is null when the frame ran out of room
+struct TransientAllocation
+{
+    const Buffer* buffer;
+    VkDeviceSize offset;
+    VkDeviceAddress deviceAddress;
+    void* data;
 };
 
 struct CommandBuffer
 {
     VkCommandBuffer handle;
+    const Pipeline* pipeline;
+    QueueType queueType;
+    // Set by every command that does work, Submit leaves out command buffers without any.
+    // State commands alone do not set it, they do not carry over to other command buffers.
+    // Commands recorded on handle directly must set it themselves.
+    bool recorded;
+
+    // Recorded by Transition, flushed as one barrier before the next action command.
+    // Buffer hazards merge into the global memory barrier, images need their own for the layout.
+    VkMemoryBarrier2 pendingMemoryBarrier;
+    std::vector<VkImageMemoryBarrier2> pendingImageBarriers;
+};
+
+enum SplitBarrierState
+{
+    SPLIT_BARRIER_IDLE,
+    SPLIT_BARRIER_RECORDING,
+    SPLIT_BARRIER_SIGNALED,
+    SPLIT_BARRIER_WAITED,
+};
+
+// Barrier split into a signal after the producer and a wait before the consumer, see AcquireSplitBarrier
+struct SplitBarrier
+{
+    VkEvent event;
+    QueueType queueType;
+    SplitBarrierState state;
+    VkMemoryBarrier2 memoryBarrier;
+    std::vector<VkImageMemoryBarrier2> imageBarriers;
 };
 
 void Startup();
 void Shutdown();
 
+uint64_t GetFrameCount();
+
+Buffer* CreateBuffer(const BufferDesc& desc);
+void DestroyBuffer(Buffer* buffer);
+// 32-bit handles for compact storage, resolved with a generation check. Null once the resource was destroyed.
+Buffer* GetBuffer(BufferHandle handle);
+Texture* GetTexture(TextureHandle handle);
+// Whether a pointer still refers to a live resource, commands assert it in debug builds
+bool IsAlive(const Buffer* buffer);
+bool IsAlive(const Texture* texture);
+
+// Makes host writes through the mapping visible to the device, a no-op for coherent memory.
+void FlushBuffer(const Buffer* buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+// Makes device writes visible to host reads of a mapped buffer, a no-op for coherent memory.
+void InvalidateBuffer(const Buffer* buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+// Writes in place through the mapping, such as a hostWrite buffer that landed in the resizable BAR, and otherwise
+// stages the data and records the copy on cmd. The device must not be reading the range. Returns false when the
+// staging ring is full this frame.
+bool WriteBuffer(CommandBuffer* cmd, Buffer* buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+Texture* CreateTexture(const TextureDesc& desc);
+void DestroyTexture(Texture* texture);
+// Tightly packed bytes of a width x height image, block compressed formats round up to whole blocks.
+VkDeviceSize GetTextureDataSize(VkFormat format, uint32_t width, uint32_t height);
+// Whether optimal tiling images of the format support every feature, queried with vkGetPhysicalDeviceFormatProperties2.
+bool IsFormatSupported(VkFormat format, VkFormatFeatureFlags2 features);
+// Task and mesh shaders of VK_EXT_mesh_shader are enabled
+bool IsMeshShaderSupported();
+// A device-local host-visible heap larger than the legacy 256 MiB BAR window, or unified memory
+bool IsResizableBarSupported();
+
+// Suballocates from one persistently mapped staging buffer shared by every uploader.
+// The region is reclaimed when the current frame retires, so the copies reading it must be recorded this frame.
+// Thread safe. Returns a null data pointer when the ring is full, retry on a later frame.
+StagingAllocation AllocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+// Like AllocateStaging, but the region is held across frames until committed, for data that arrives asynchronously.
+// Regions are reclaimed in allocation order, so a reservation also holds back every region allocated after it.
+StagingAllocation ReserveStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+// The copies reading a reserved region must be recorded in the frame it is committed.
+void CommitStaging(const StagingAllocation& allocation);
+
+// Bump allocates short-lived constants and per-draw data from the current frame's persistently mapped buffer,
+// placed in device-local memory when the host can write it directly. Lock free, every allocation of a frame
+// is reclaimed at once when the frame retires, so the commands reading it must be recorded this frame.
+// Offsets are aligned for dynamic uniform and storage buffer bindings.
+// Returns a null data pointer when the frame is out of room.
+TransientAllocation AllocateTransient(VkDeviceSize size, VkDeviceSize alignment = 16);
+template <typename T>
+TransientAllocation WriteTransient(const T& data)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    TransientAllocation allocation = AllocateTransient(sizeof(T), alignof(T));
+    if (allocation.data != nullptr)
+    {
+        memcpy(allocation.data, &data, sizeof(T));
+    }
+    return allocation;
+}
+
+// Per-category totals are kept up to date on create/destroy, so this is cheap to poll.
+MemoryStats GetMemoryStats();
+// Writes the full vmaBuildStatsString JSON to the given file.
+bool DumpMemoryStats(const char* path);
+
+Shader* CreateShader(std::span<const uint32_t> spirv);
+void DestroyShader(Shader* shader);
+
+// Pipeline layouts are built from the reflected push constants and descriptor sets of their shaders.
+Pipeline* CreateComputePipeline(const Shader* computeShader);
+Pipeline* CreateGraphicsPipeline(const GraphicsPipelineDesc& desc);
+// Compiled on the job system with the shared pipeline cache, the shaders must outlive the compile.
+// Until ready, CmdBindPipeline binds the fallback, or skips the dependent commands if there is none.
+// Pending pipelines bound this frame are compiled first.
+// With VK_EXT_graphics_pipeline_library, graphics pipelines are fast-linked from shared library parts
+// and replaced by a link-time optimized pipeline once the background link finishes.
+Pipeline* CreateComputePipelineAsync(const Shader* computeShader, const Pipeline* fallback = nullptr);
+Pipeline* CreateGraphicsPipelineAsync(const GraphicsPipelineDesc& desc, const Pipeline* fallback = nullptr);
+bool IsPipelineReady(const Pipeline* pipeline);
+void DestroyPipeline(Pipeline* pipeline);
+// Blocks until every queued compile, including background optimization, has finished.
+void WaitForPipelines();
+
+// Merges a blob written by SavePipelineCache into the shared cache.
+// The driver ignores blobs from another device or driver version.
+bool LoadPipelineCache(const char* path);
+bool SavePipelineCache(const char* path);
+bool LoadPipelineStateList(const char* path, std::vector<PipelineStateRecord>& records);
+
+// Logs every unique graphics pipeline state created from now on, with the frame it was first created.
+// The list is written on stop, or at Shutdown if still recording.
+void StartPipelineStateRecording(const char* path);
+bool StopPipelineStateRecording();
+// Resolves the key's shader hashes against shaders, vertexShader and meshShader are null if any is missing.
+// colorFormats and vertexAttributes point into key, which must outlive the desc.
+GraphicsPipelineDesc GetGraphicsPipelineDesc(const PipelineStateKey& key, std::span<const Shader* const> shaders);
+// Queues every recorded state with a resolvable shader through GetGraphicsPipeline, in first use order.
+// Later GetGraphicsPipeline calls for the same state hit the replayed pipelines.
+uint32_t ReplayPipelineStateList(const char* path, std::span<const Shader* const> shaders);
+
+PipelineStateKey GetPipelineStateKey(const GraphicsPipelineDesc& desc);
+uint64_t HashPipelineState(const PipelineStateKey& key);
+// Returns the pipeline for the desc's state, creating it asynchronously on the first request.
+// Lookups take no lock. Cached pipelines are owned by the cache and destroyed at Shutdown.
+const Pipeline* GetGraphicsPipeline(const GraphicsPipelineDesc& desc, const Pipeline* fallback = nullptr);
+PipelineCacheStats GetPipelineCacheStats();
+
+// Incrementally compacts the allocator, moving at most the given budget per pass.
+// Moved buffers keep their Buffer* but get a new handle and device address at the start of a frame.
+void BeginDefragmentation(uint32_t maxMovesPerPass = 64, VkDeviceSize maxBytesPerPass = 64ull << 20);
+void EndDefragmentation();
+bool IsDefragmenting();
+
 CommandBuffer* GetCmdBuffer(QueueType queueType = QUEUE_GRAPHICS);
 void NextCmdBuffer(QueueType queueType = QUEUE_GRAPHICS);
+// Adds a semaphore to the queue's submit of the current frame, value is ignored for binary semaphores.
+// The stage mask is exact: a wait only blocks the given stages, a signal waits for the given stages to finish.
+void AddSubmitWait(QueueType queueType, VkSemaphore semaphore, VkPipelineStageFlags2 stages, uint64_t value = 0);
+void AddSubmitSignal(QueueType queueType, VkSemaphore semaphore, VkPipelineStageFlags2 stages, uint64_t value = 0);
+// Submits each queue once with vkQueueSubmit2, with only the command buffers that recorded work.
+// The copy queue is skipped when it recorded nothing and nothing was added to its submit, graphics then does not
+// wait on it. Graphics is always submitted for the frame's fence, without command buffers on an idle frame.
 void Submit();
+// Restores the policy Submit had before idle work was skipped: every command buffer in use is submitted, and the
+// copy queue is submitted every frame with graphics waiting on it. Only meant for measuring, see BlastBench submit.
+void SetSubmitIdleQueues(bool enabled);
+
+// Records the barrier the resource needs for its next use, against the uses tracked so far.
+// Repeated reads the last barrier already covers are elided and reads after reads merge into one state,
+// so only writes, new read stages and layout changes cost a barrier. Barriers batch into a single
+// vkCmdPipelineBarrier2 issued by the next action command or FlushBarriers.
+// Tracking follows recording order, which must match submission order across command buffers and queues.
+// Resources are shared by both queues without ownership transfers: on the copy queue, stages it cannot execute
+// are left to the semaphore between the queues. Mixing Transition with hand-written barriers on a resource desyncs its state.
+void Transition(CommandBuffer* cmd, Buffer* buffer, ResourceUse use);
+void Transition(CommandBuffer* cmd, Texture* texture, ResourceUse use);
+// Action commands flush by themselves, call it before vkCmdBeginRendering since barriers cannot go inside it
+void FlushBarriers(CommandBuffer* cmd);
+
+// Split barriers let independent work overlap a transition instead of draining the pipeline at it:
+//
+//     SplitBarrier* barrier = AcquireSplitBarrier();
+//     SplitTransition(barrier, buffer, RESOURCE_USE_INDIRECT_READ);
+//     SignalSplitBarrier(cmd, barrier);  // vkCmdSetEvent2, right after the producer
+//     ...                                // unrelated work
+//     WaitSplitBarrier(cmd, barrier);    // vkCmdWaitEvents2, right before the consumer
+//
+// SplitTransition updates the tracked state like Transition, so the resource must not be used in between.
+// Signal and wait must be recorded on the same queue, the wait after the signal in submission order.
+// Barriers come from a per-frame pool of events, valid until the frame retires. Every signaled barrier must be waited.
+SplitBarrier* AcquireSplitBarrier(QueueType queueType = QUEUE_GRAPHICS);
+void SplitTransition(SplitBarrier* barrier, Buffer* buffer, ResourceUse use);
+void SplitTransition(SplitBarrier* barrier, Texture* texture, ResourceUse use);
+void SignalSplitBarrier(CommandBuffer* cmd, SplitBarrier* barrier);
+void WaitSplitBarrier(CommandBuffer* cmd, SplitBarrier* barrier);
+
+// Returns false when neither the pipeline nor its fallback is ready, the following commands are then dropped.
+bool CmdBindPipeline(CommandBuffer* cmd, const Pipeline* pipeline);
+// Viewport and scissor are dynamic for both pipelines and shader objects
+void CmdSetViewport(CommandBuffer* cmd, const VkViewport& viewport, const VkRect2D& scissor);
+void CmdPushConstants(CommandBuffer* cmd, const void* data, uint32_t size, uint32_t offset = 0);
+// Per-draw payloads must fit the 128 bytes every device guarantees
+template <typename T>
+void CmdPushConstants(CommandBuffer* cmd, const T& data, uint32_t offset = 0)
+{
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= 128);
+    CmdPushConstants(cmd, &data, sizeof(T), offset);
+}
+// Allocates a set from the calling thread's pool for this frame and fills it through the update template.
+// Sets are never freed individually, the pools are reset when the frame retires.
+// PUSH_DESCRIPTOR_SET is pushed into the command buffer without any allocation when supported.
+void CmdBindDescriptors(CommandBuffer* cmd, uint32_t set, std::span<const DescriptorInfo> descriptors);
+void CmdDispatch(CommandBuffer* cmd, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+void CmdFillBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data);
+void CmdUpdateBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkDeviceSize size, const void* data);
+void CmdMemoryBarrier(CommandBuffer* cmd, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+// Covers every mip of the texture
+void CmdTextureBarrier(CommandBuffer* cmd,
+                       const Texture* texture,
+                       VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+                       VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess,
+                       VkImageLayout oldLayout, VkImageLayout newLayout);
+void CmdCopyBuffer(CommandBuffer* cmd, const Buffer* srcBuffer, VkDeviceSize srcOffset, const Buffer* dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+// Copies tightly packed data of one whole mip, the texture must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+void CmdCopyBufferToTexture(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize bufferOffset, const Texture* texture, uint32_t mipLevel);
+void CmdBindIndexBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset, VkIndexType indexType);
+// Binding 0 of pipelines with a vertex layout
+void CmdBindVertexBuffer(CommandBuffer* cmd, const Buffer* buffer, VkDeviceSize offset);
+void CmdDrawIndexedIndirectCount(CommandBuffer* cmd,
+                                 const Buffer* argsBuffer, VkDeviceSize argsOffset,
+                                 const Buffer* countBuffer, VkDeviceSize countOffset,
+                                 uint32_t maxDrawCount);
+// Launches task shader workgroups, or mesh shader workgroups when the pipeline has no task shader
+void CmdDrawMeshTasks(CommandBuffer* cmd, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
 } // namespace rhi
\ No newline at end of file
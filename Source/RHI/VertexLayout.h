@@ -0,0 +1,161 @@
+#pragma once
+
+#include "RHI/RHI.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace rhi
+{
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t floatExponent = (bits >> 23) & 0xFF;
+    int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (floatExponent == 0xFF)
+    {
+        // Infinity stays infinity, NaN stays NaN
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    if (exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+        // Denormal, the implicit leading one becomes explicit
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = (mantissa >> shift) + ((mantissa >> (shift - 1)) & 1);
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // Rounds to nearest, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return static_cast<uint16_t>(half);
+}
+
+// Signed normalized integer of the given bit count, in the low bits
+inline uint32_t PackSnorm(float value, uint32_t bits)
+{
+    float scale = static_cast<float>((1u << (bits - 1)) - 1);
+    int32_t quantized = static_cast<int32_t>(lroundf(std::clamp(value, -1.0f, 1.0f) * scale));
+    return static_cast<uint32_t>(quantized) & ((1u << bits) - 1);
+}
+
+// Attribute encodings of a VertexLayout. Each packs componentCount source floats into size bytes
+// and names the format the vertex input reads them with.
+
+// 12 bytes, full precision
+struct VertexFloat3
+{
+    static constexpr uint32_t componentCount = 3;
+    static constexpr uint32_t size = 12;
+    static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+
+    static void Pack(const float* src, uint8_t* dst)
+    {
+        memcpy(dst, src, size);
+    }
+};
+
+// 4 bytes, a direction projected onto the octahedron with the lower hemisphere folded over the diagonals.
+// The shader reads a vec2 and unfolds it, see DecodeOctahedral in Shaders/Mesh.glsl.
+struct VertexOctahedralNormal
+{
+    static constexpr uint32_t componentCount = 3;
+    static constexpr uint32_t size = 4;
+    static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM;
+
+    static void Pack(const float* src, uint8_t* dst)
+    {
+        float l1 = fabsf(src[0]) + fabsf(src[1]) + fabsf(src[2]);
+        float x = l1 > 0.0f ? src[0] / l1 : 0.0f;
+        float y = l1 > 0.0f ? src[1] / l1 : 0.0f;
+        if (src[2] < 0.0f)
+        {
+            float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        uint32_t packed = PackSnorm(x, 16) | PackSnorm(y, 16) << 16;
+        memcpy(dst, &packed, size);
+    }
+};
+
+// 4 bytes, texture coordinates as two halfs
+struct VertexHalf2
+{
+    static constexpr uint32_t componentCount = 2;
+    static constexpr uint32_t size = 4;
+    static constexpr VkFormat format = VK_FORMAT_R16G16_SFLOAT;
+
+    static void Pack(const float* src, uint8_t* dst)
+    {
+        uint32_t packed = FloatToHalf(src[0]) | static_cast<uint32_t>(FloatToHalf(src[1])) << 16;
+        memcpy(dst, &packed, size);
+    }
+};
+
+// 4 bytes, tangent direction in xyz and bitangent sign in w
+struct VertexSnormTangent
+{
+    static constexpr uint32_t componentCount = 4;
+    static constexpr uint32_t size = 4;
+    static constexpr VkFormat format = VK_FORMAT_R8G8B8A8_SNORM;
+
+    static void Pack(const float* src, uint8_t* dst)
+    {
+        uint32_t packed = PackSnorm(src[0], 8) | PackSnorm(src[1], 8) << 8 | PackSnorm(src[2], 8) << 16 |
+                          PackSnorm(src[3] < 0.0f ? -1.0f : 1.0f, 8) << 24;
+        memcpy(dst, &packed, size);
+    }
+};
+
+// Interleaved vertex of binding 0, attribute i at location i, tightly packed in declaration order.
+// Both the pipeline's vertex input and the CPU packing derive from the attribute list, so they cannot drift apart:
+//
+//     using Layout = VertexLayout<VertexFloat3, VertexOctahedralNormal, VertexHalf2>;
+//     Layout::Pack(dst, position, normal, uv);
+//     SetVertexLayout<Layout>(pipelineDesc);
+template <typename... Attributes>
+struct VertexLayout
+{
+    static_assert(sizeof...(Attributes) > 0 && sizeof...(Attributes) <= MAX_VERTEX_ATTRIBUTE_COUNT);
+
+    static constexpr uint32_t attributeCount = sizeof...(Attributes);
+    static constexpr uint32_t stride = (Attributes::size + ...);
+    static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributes = []()
+    {
+        std::array<VkVertexInputAttributeDescription, attributeCount> result = {};
+        uint32_t location = 0;
+        uint32_t offset = 0;
+        ((result[location] = {location, 0, Attributes::format, offset}, offset += Attributes::size, ++location), ...);
+        return result;
+    }();
+
+    // One source per attribute, in declaration order, with exactly its componentCount floats
+    static void Pack(void* vertex, std::span<const float, Attributes::componentCount>... sources)
+    {
+        uint8_t* dst = static_cast<uint8_t*>(vertex);
+        ((Attributes::Pack(sources.data(), dst), dst += Attributes::size), ...);
+    }
+};
+
+template <typename Layout>
+void SetVertexLayout(GraphicsPipelineDesc& desc)
+{
+    desc.vertexStride = Layout::stride;
+    desc.vertexAttributes = Layout::attributes;
+}
+} // namespace rhi
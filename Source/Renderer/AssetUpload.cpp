@@ -0,0 +1,368 @@
+#include "AssetUpload.h"
+#include "TextureTranscode.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace renderer
+{
+static rhi::Buffer* CreateMeshBuffer(const asset::AssetEntry* entry, VkBufferUsageFlags usage)
+{
+    rhi::BufferDesc bufferDesc = {};
+    bufferDesc.size = entry->size;
+    bufferDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY;
+    bufferDesc.bufferUsage = usage;
+    bufferDesc.category = rhi::MEMORY_CATEGORY_GEOMETRY;
+    return rhi::CreateBuffer(bufferDesc);
+}
+
+static rhi::Buffer* RecordMeshUpload(const asset::AssetEntry* entry, const rhi::StagingAllocation& staging, rhi::Buffer* buffer)
+{
+    rhi::CommandBuffer* cmd = rhi::GetCmdBuffer(rhi::QUEUE_COPY);
+    rhi::CmdCopyBuffer(cmd, staging.buffer, staging.offset, buffer, 0, entry->size);
+    return buffer;
+}
+
+// Mips keep the pack's alignment, so the blob is staged as one region
+static rhi::Texture* RecordTextureUpload(const asset::AssetEntry* entry, VkFormat format, const rhi::StagingAllocation& staging)
+{
+    rhi::TextureDesc textureDesc = {};
+    textureDesc.width = entry->width;
+    textureDesc.height = entry->height;
+    textureDesc.mipLevels = entry->mipCount;
+    textureDesc.format = format;
+    textureDesc.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    rhi::Texture* texture = rhi::CreateTexture(textureDesc);
+
+    rhi::CommandBuffer* cmd = rhi::GetCmdBuffer(rhi::QUEUE_COPY);
+    rhi::Transition(cmd, texture, rhi::RESOURCE_USE_TRANSFER_WRITE);
+    for (uint32_t mip = 0; mip < entry->mipCount; ++mip)
+    {
+        VkDeviceSize offset = GetPackedMipOffset(format, entry->width, entry->height, mip);
+        rhi::CmdCopyBufferToTexture(cmd, staging.buffer, staging.offset + offset, texture, mip);
+    }
+    rhi::Transition(cmd, texture, rhi::RESOURCE_USE_GRAPHICS_READ);
+    return texture;
+}
+
+// Tells a blob that can never be staged apart from a staging ring that is only full this frame
+static bool FitsStagingRing(const asset::AssetEntry* entry, VkDeviceSize size)
+{
+    if (size > STAGING_RING_SIZE)
+    {
+        LOGE("Asset %016llx does not fit in the staging ring.\n", (unsigned long long)entry->nameHash);
+        return false;
+    }
+    return true;
+}
+
+rhi::Buffer* UploadMesh(const asset::AssetPack* pack, const asset::AssetEntry* entry, VkBufferUsageFlags usage)
+{
+    assert(entry->type == asset::ASSET_TYPE_MESH || entry->type == asset::ASSET_TYPE_RAW);
+    std::span<const uint8_t> data = asset::GetAssetData(pack, entry);
+    if (!FitsStagingRing(entry, data.size()))
+    {
+        return nullptr;
+    }
+    rhi::StagingAllocation staging = rhi::AllocateStaging(data.size());
+    if (staging.data == nullptr)
+    {
+        return nullptr;
+    }
+    memcpy(staging.data, data.data(), data.size());
+    return RecordMeshUpload(entry, staging, CreateMeshBuffer(entry, usage));
+}
+
+rhi::Texture* UploadTexture(const asset::AssetPack* pack, const asset::AssetEntry* entry)
+{
+    assert(entry->type == asset::ASSET_TYPE_TEXTURE);
+    std::span<const uint8_t> data = asset::GetAssetData(pack, entry);
+    if (entry->flags & asset::ASSET_FLAG_SUPERCOMPRESSED)
+    {
+        // Transcoded straight into the staging region
+        VkFormat format = GetTranscodeFormat(entry);
+        VkDeviceSize size = GetPackedMipOffset(format, entry->width, entry->height, entry->mipCount);
+        if (!FitsStagingRing(entry, size))
+        {
+            return nullptr;
+        }
+        rhi::StagingAllocation staging = rhi::AllocateStaging(size, ASSET_MIP_ALIGNMENT);
+        if (staging.data == nullptr)
+        {
+            return nullptr;
+        }
+        if (!TranscodeTexture(entry, data, format, std::span(static_cast<uint8_t*>(staging.data), size)))
+        {
+            LOGE("Failed to transcode texture %016llx.\n", (unsigned long long)entry->nameHash);
+            return nullptr;
+        }
+        return RecordTextureUpload(entry, format, staging);
+    }
+
+    if (!FitsStagingRing(entry, data.size()))
+    {
+        return nullptr;
+    }
+    rhi::StagingAllocation staging = rhi::AllocateStaging(data.size(), ASSET_MIP_ALIGNMENT);
+    if (staging.data == nullptr)
+    {
+        return nullptr;
+    }
+    memcpy(staging.data, data.data(), data.size());
+    return RecordTextureUpload(entry, static_cast<VkFormat>(entry->format), staging);
+}
+
+rhi::Shader* CreateShader(const asset::AssetPack* pack, const asset::AssetEntry* entry)
+{
+    assert(entry->type == asset::ASSET_TYPE_SHADER);
+    // Blobs are aligned in the file and the mapping is page aligned
+    std::span<const uint8_t> data = asset::GetAssetData(pack, entry);
+    return rhi::CreateShader(std::span(reinterpret_cast<const uint32_t*>(data.data()), data.size() / sizeof(uint32_t)));
+}
+
+StreamingTextureDesc GetStreamingTextureDesc(const asset::AssetPack* pack, const asset::AssetEntry* entry)
+{
+    assert(entry->type == asset::ASSET_TYPE_TEXTURE && !(entry->flags & asset::ASSET_FLAG_SUPERCOMPRESSED));
+    StreamingTextureDesc desc = {};
+    desc.width = entry->width;
+    desc.height = entry->height;
+    desc.mipCount = entry->mipCount;
+    desc.format = static_cast<VkFormat>(entry->format);
+    desc.readMip = [pack, entry](uint32_t mip, std::span<uint8_t> dst)
+    {
+        std::span<const uint8_t> data = asset::GetAssetData(pack, entry);
+        VkDeviceSize offset = GetPackedMipOffset(static_cast<VkFormat>(entry->format), entry->width, entry->height, mip);
+        if (offset + dst.size() > data.size())
+        {
+            return false;
+        }
+        memcpy(dst.data(), data.data() + offset, dst.size());
+        return true;
+    };
+    return desc;
+}
+
+AssetLoader* CreateAssetLoader(const char* path)
+{
+    asset::AssetPack* pack = asset::OpenAssetPack(path);
+    asyncio::File* file = pack != nullptr ? asyncio::OpenFile(path) : nullptr;
+    if (file == nullptr)
+    {
+        asset::CloseAssetPack(pack);
+        return nullptr;
+    }
+
+    AssetLoader* loader = new AssetLoader();
+    loader->pack = pack;
+    loader->file = file;
+    return loader;
+}
+
+static VkDeviceSize GetTranscodedSize(const AssetLoad* load)
+{
+    VkDeviceSize size = GetPackedMipOffset(load->format, load->entry->width, load->entry->height, load->entry->mipCount);
+    return (size + ASSET_MIP_ALIGNMENT - 1) & ~VkDeviceSize(ASSET_MIP_ALIGNMENT - 1);
+}
+
+static bool IsSupercompressed(const AssetLoad* load)
+{
+    return load->entry->type == asset::ASSET_TYPE_TEXTURE && (load->entry->flags & asset::ASSET_FLAG_SUPERCOMPRESSED);
+}
+
+// Both the transcoded mips and the blob they are transcoded from live in one staging region
+static VkDeviceSize GetStagingSize(const AssetLoad* load)
+{
+    return IsSupercompressed(load) ? GetTranscodedSize(load) + load->entry->size : load->entry->size;
+}
+
+// The copies are recorded this frame, so the region is committed to it either way
+static void RecordUpload(AssetLoad* load, bool success)
+{
+    rhi::CommitStaging(load->staging);
+    if (load->cancelled)
+    {
+        delete load;
+        return;
+    }
+
+    if (!success)
+    {
+        LOGE("Failed to load asset %016llx.\n", (unsigned long long)load->entry->nameHash);
+        load->state = ASSET_LOAD_FAILED;
+        return;
+    }
+
+    if (load->entry->type == asset::ASSET_TYPE_TEXTURE)
+    {
+        load->texture = RecordTextureUpload(load->entry, load->format, load->staging);
+    }
+    else
+    {
+        load->buffer = RecordMeshUpload(load->entry, load->staging, CreateMeshBuffer(load->entry, load->usage));
+    }
+    load->state = ASSET_LOAD_READY;
+}
+
+static void TranscodeLoad(AssetLoad* load)
+{
+    VkDeviceSize transcodedSize = GetTranscodedSize(load);
+    uint8_t* data = static_cast<uint8_t*>(load->staging.data);
+    std::span<const uint8_t> src(data + transcodedSize, load->entry->size);
+    load->transcodeFailed = !TranscodeTexture(load->entry, src, load->format, std::span(data, transcodedSize));
+    load->transcoded.store(true, std::memory_order_release);
+}
+
+static void FinishLoad(AssetLoad* load, bool success)
+{
+    if (!success || load->cancelled || !IsSupercompressed(load))
+    {
+        RecordUpload(load, success);
+        return;
+    }
+
+    load->state = ASSET_LOAD_TRANSCODING;
+    load->loader->transcoding.push_back(load);
+    if (jobsystem::GetThreadCount() <= 1)
+    {
+        // FinishTranscodes only polls, without a worker the job would wait for DestroyAssetLoader
+        TranscodeLoad(load);
+        return;
+    }
+    jobsystem::Execute(load->loader->counter, [load](jobsystem::JobArgs) { TranscodeLoad(load); });
+}
+
+static void FinishTranscodes(AssetLoader* loader)
+{
+    for (size_t i = 0; i < loader->transcoding.size();)
+    {
+        AssetLoad* load = loader->transcoding[i];
+        if (!load->transcoded.load(std::memory_order_acquire))
+        {
+            ++i;
+            continue;
+        }
+
+        loader->transcoding[i] = loader->transcoding.back();
+        loader->transcoding.pop_back();
+        RecordUpload(load, !load->transcodeFailed);
+    }
+}
+
+static void PollLoads()
+{
+    asyncio::ReadCompletion completions[64];
+    uint32_t count = 0;
+    while ((count = asyncio::PollReads(completions)) > 0)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            FinishLoad(reinterpret_cast<AssetLoad*>(completions[i].userData), completions[i].success);
+        }
+    }
+}
+
+void DestroyAssetLoader(AssetLoader* loader)
+{
+    if (loader == nullptr)
+    {
+        return;
+    }
+
+    for (AssetLoad* load : loader->queued)
+    {
+        load->state = ASSET_LOAD_FAILED;
+    }
+    loader->queued.clear();
+
+    // Reads in flight and transcodes target the staging ring and reference the mapped entries
+    while (asyncio::GetPendingReadCount() > 0)
+    {
+        PollLoads();
+    }
+    jobsystem::Wait(loader->counter);
+    FinishTranscodes(loader);
+
+    asyncio::CloseFile(loader->file);
+    asset::CloseAssetPack(loader->pack);
+    delete loader;
+}
+
+static AssetLoad* QueueLoad(AssetLoader* loader, const asset::AssetEntry* entry, VkBufferUsageFlags usage)
+{
+    AssetLoad* load = new AssetLoad();
+    load->loader = loader;
+    load->entry = entry;
+    load->usage = usage;
+    load->state = ASSET_LOAD_QUEUED;
+    load->format = static_cast<VkFormat>(entry->format);
+    if (IsSupercompressed(load))
+    {
+        load->format = GetTranscodeFormat(entry);
+    }
+
+    if (!FitsStagingRing(entry, GetStagingSize(load)))
+    {
+        load->state = ASSET_LOAD_FAILED;
+        return load;
+    }
+
+    loader->queued.push_back(load);
+    return load;
+}
+
+AssetLoad* LoadMeshAsync(AssetLoader* loader, const asset::AssetEntry* entry, VkBufferUsageFlags usage)
+{
+    assert(entry->type == asset::ASSET_TYPE_MESH || entry->type == asset::ASSET_TYPE_RAW);
+    return QueueLoad(loader, entry, usage);
+}
+
+AssetLoad* LoadTextureAsync(AssetLoader* loader, const asset::AssetEntry* entry)
+{
+    assert(entry->type == asset::ASSET_TYPE_TEXTURE);
+    return QueueLoad(loader, entry, 0);
+}
+
+void DestroyAssetLoad(AssetLoader* loader, AssetLoad* load)
+{
+    if (load == nullptr)
+    {
+        return;
+    }
+
+    if (load->state == ASSET_LOAD_READING || load->state == ASSET_LOAD_TRANSCODING)
+    {
+        // Freed once finished, the read or transcode still targets the staging region
+        load->cancelled = true;
+        return;
+    }
+
+    if (load->state == ASSET_LOAD_QUEUED)
+    {
+        loader->queued.erase(std::find(loader->queued.begin(), loader->queued.end(), load));
+    }
+    delete load;
+}
+
+void UpdateAssetLoader(AssetLoader* loader)
+{
+    PollLoads();
+    FinishTranscodes(loader);
+
+    // In order, a large load at the front is not starved by smaller ones behind it
+    while (!loader->queued.empty())
+    {
+        AssetLoad* load = loader->queued.front();
+        VkDeviceSize alignment = load->entry->type == asset::ASSET_TYPE_TEXTURE ? ASSET_MIP_ALIGNMENT : 16;
+        load->staging = rhi::ReserveStaging(GetStagingSize(load), alignment);
+        if (load->staging.data == nullptr)
+        {
+            break;
+        }
+
+        loader->queued.pop_front();
+        load->state = ASSET_LOAD_READING;
+        uint8_t* dst = static_cast<uint8_t*>(load->staging.data) + (IsSupercompressed(load) ? GetTranscodedSize(load) : 0);
+        asyncio::Read(loader->file, load->entry->offset, load->entry->size, dst, reinterpret_cast<uint64_t>(load));
+    }
+}
+} // namespace renderer
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Foundation/AssetPack.h"
+#include "Foundation/AsyncIO.h"
+#include "Foundation/JobSystem.h"
+#include "Renderer/TextureStreaming.h"
+
+#include <deque>
+
+namespace renderer
+{
+// Blobs are copied straight from the pack mapping into the staging ring and uploaded on the copy queue,
+// the graphics queue waits for that submission, so the results are usable by this frame's draws.
+// Uploads return null when the staging ring has no room this frame, and may succeed on a later frame.
+// Blobs larger than STAGING_RING_SIZE, after transcoding for supercompressed textures, never fit:
+// they log an error and return null on every call, so stream such textures mip by mip instead.
+
+// Static meshes always go through the staging ring, leaving the resizable BAR to buffers the host rewrites
+rhi::Buffer* UploadMesh(const asset::AssetPack* pack, const asset::AssetEntry* entry, VkBufferUsageFlags usage);
+// The texture is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+rhi::Texture* UploadTexture(const asset::AssetPack* pack, const asset::AssetEntry* entry);
+// Reflects the SPIR-V in place, the mapping is not referenced afterwards
+rhi::Shader* CreateShader(const asset::AssetPack* pack, const asset::AssetEntry* entry);
+
+// Streams the texture's mips from the mapping, the pack must outlive the streaming texture.
+// Supercompressed textures can't be streamed, pack textures meant for streaming without --supercompress.
+StreamingTextureDesc GetStreamingTextureDesc(const asset::AssetPack* pack, const asset::AssetEntry* entry);
+
+enum AssetLoadState
+{
+    // Waiting for room in the staging ring
+    ASSET_LOAD_QUEUED = 0,
+    // Read from disk straight into its staging region
+    ASSET_LOAD_READING = 1,
+    // Supercompressed texture being transcoded on the job system, into the same staging region
+    ASSET_LOAD_TRANSCODING = 2,
+    // Upload recorded on the copy queue, usable by this frame's draws
+    ASSET_LOAD_READY = 3,
+    ASSET_LOAD_FAILED = 4
+};
+
+struct AssetLoader;
+
+struct AssetLoad
+{
+    AssetLoader* loader;
+    const asset::AssetEntry* entry;
+    VkBufferUsageFlags usage;
+    AssetLoadState state;
+    // Released by the loader when destroyed while reading or transcoding
+    bool cancelled;
+    // Supercompressed textures reserve room for the transcoded mips ahead of the blob read from disk
+    rhi::StagingAllocation staging;
+    VkFormat format;
+    std::atomic<bool> transcoded;
+    bool transcodeFailed;
+
+    // Owned by the caller once ready
+    rhi::Buffer* buffer;
+    rhi::Texture* texture;
+};
+
+// Loads blobs with asyncio instead of the mapping, so disk reads, uploads and the GPU overlap across frames
+// and the main thread never blocks on a read. The table of contents is still read from the mapping.
+struct AssetLoader
+{
+    asset::AssetPack* pack;
+    asyncio::File* file;
+    std::deque<AssetLoad*> queued;
+    std::vector<AssetLoad*> transcoding;
+    jobsystem::Counter counter;
+};
+
+// asyncio must be initialized
+AssetLoader* CreateAssetLoader(const char* path);
+// Waits for the reads in flight of every loader. Loads still queued are left failed, not destroyed.
+void DestroyAssetLoader(AssetLoader* loader);
+
+AssetLoad* LoadMeshAsync(AssetLoader* loader, const asset::AssetEntry* entry, VkBufferUsageFlags usage);
+AssetLoad* LoadTextureAsync(AssetLoader* loader, const asset::AssetEntry* entry);
+// Does not destroy the loaded buffer or texture
+void DestroyAssetLoad(AssetLoader* loader, AssetLoad* load);
+
+// Call once per frame before Submit, on the thread that polls asyncio.
+// Records the uploads of reads that completed, for any loader, then starts the queued reads that fit in the staging ring.
+void UpdateAssetLoader(AssetLoader* loader);
+} // namespace renderer
@@ -0,0 +1,156 @@
+#include "IndirectDraw.h"
+
+#include <assert.h>
+
+#define CULL_GROUP_SIZE 64
+
+namespace renderer
+{
+struct CullPushConstants
+{
+    VkDeviceAddress instances;
+    VkDeviceAddress meshDraws;
+    VkDeviceAddress drawCommands;
+    VkDeviceAddress drawCount;
+    VkDeviceAddress view;
+    VkDeviceAddress hiz;
+    uint32_t instanceCount;
+    uint32_t maxDrawCount;
+    uint32_t occlusionCulling;
+    uint32_t padding;
+};
+
+IndirectDraw* CreateIndirectDraw(const IndirectDrawDesc& desc)
+{
+    IndirectDraw* indirectDraw = new IndirectDraw();
+    indirectDraw->maxDrawCount = desc.maxDrawCount;
+    indirectDraw->cullPipeline = rhi::CreateComputePipeline(desc.cullShader);
+
+    rhi::BufferDesc commandsDesc = {};
+    commandsDesc.size = sizeof(VkDrawIndexedIndirectCommand) * desc.maxDrawCount;
+    commandsDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY;
+    commandsDesc.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    indirectDraw->drawCommands = rhi::CreateBuffer(commandsDesc);
+
+    rhi::BufferDesc countDesc = {};
+    countDesc.size = sizeof(uint32_t);
+    countDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY;
+    countDesc.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    indirectDraw->drawCount = rhi::CreateBuffer(countDesc);
+
+    indirectDraw->maxInstanceCount = desc.maxInstanceCount;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT && desc.maxInstanceCount > 0; ++i)
+    {
+        rhi::BufferDesc instancesDesc = {};
+        instancesDesc.size = sizeof(GpuInstance) * desc.maxInstanceCount;
+        instancesDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY;
+        instancesDesc.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        instancesDesc.hostWrite = true;
+        indirectDraw->instances[i] = rhi::CreateBuffer(instancesDesc);
+    }
+
+    return indirectDraw;
+}
+
+void DestroyIndirectDraw(IndirectDraw* indirectDraw)
+{
+    if (indirectDraw == nullptr)
+    {
+        return;
+    }
+
+    rhi::DestroyPipeline(indirectDraw->cullPipeline);
+    rhi::DestroyBuffer(indirectDraw->drawCommands);
+    rhi::DestroyBuffer(indirectDraw->drawCount);
+    for (rhi::Buffer* instances : indirectDraw->instances)
+    {
+        rhi::DestroyBuffer(instances);
+    }
+    delete indirectDraw;
+}
+
+const rhi::Buffer* WriteInstances(rhi::CommandBuffer* cmd, IndirectDraw* indirectDraw, std::span<const GpuInstance> instances)
+{
+    assert(instances.size() <= indirectDraw->maxInstanceCount);
+    // The frame that last read this buffer retired before the current frame started
+    rhi::Buffer* buffer = indirectDraw->instances[rhi::GetFrameCount() % MAX_FRAMES_IN_FLIGHT];
+    if (!rhi::WriteBuffer(cmd, buffer, 0, instances.data(), instances.size_bytes()))
+    {
+        return nullptr;
+    }
+    rhi::Transition(cmd, buffer, rhi::RESOURCE_USE_COMPUTE_READ);
+    return buffer;
+}
+
+void CullInstances(rhi::CommandBuffer* cmd,
+                   IndirectDraw* indirectDraw,
+                   const CullView& view,
+                   const rhi::Buffer* instances,
+                   uint32_t instanceCount,
+                   const rhi::Buffer* meshDraws,
+                   const rhi::Buffer* hiz)
+{
+    // Each frame writes its own transient copy, so no frame in flight can observe a partial update
+    rhi::TransientAllocation viewAllocation = rhi::WriteTransient(view);
+    indirectDraw->view = viewAllocation.deviceAddress;
+
+    // The previous frame's indirect draw reads both outputs on the same queue
+    rhi::Transition(cmd, indirectDraw->drawCount, rhi::RESOURCE_USE_TRANSFER_WRITE);
+    rhi::CmdFillBuffer(cmd, indirectDraw->drawCount, 0, sizeof(uint32_t), 0);
+    rhi::Transition(cmd, indirectDraw->drawCount, rhi::RESOURCE_USE_COMPUTE_WRITE);
+    rhi::Transition(cmd, indirectDraw->drawCommands, rhi::RESOURCE_USE_COMPUTE_WRITE);
+
+    CullPushConstants pushConstants = {};
+    pushConstants.instances = instances->deviceAddress;
+    pushConstants.meshDraws = meshDraws->deviceAddress;
+    pushConstants.drawCommands = indirectDraw->drawCommands->deviceAddress;
+    pushConstants.drawCount = indirectDraw->drawCount->deviceAddress;
+    pushConstants.view = indirectDraw->view;
+    pushConstants.hiz = hiz != nullptr ? hiz->deviceAddress : 0;
+    pushConstants.instanceCount = instanceCount;
+    pushConstants.maxDrawCount = indirectDraw->maxDrawCount;
+    pushConstants.occlusionCulling = hiz != nullptr ? 1 : 0;
+
+    // Out of transient memory, the cull is skipped and the cleared draw count draws nothing this frame
+    if (viewAllocation.data == nullptr)
+    {
+        LOGW("Out of transient memory, instances are not drawn this frame.\n");
+    }
+    else
+    {
+        rhi::CmdBindPipeline(cmd, indirectDraw->cullPipeline);
+        rhi::CmdPushConstants(cmd, pushConstants);
+        rhi::CmdDispatch(cmd, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE);
+    }
+
+    // Split, so work recorded until WaitCulledInstances overlaps the end of the cull dispatch
+    indirectDraw->culled = rhi::AcquireSplitBarrier(cmd->queueType);
+    rhi::SplitTransition(indirectDraw->culled, indirectDraw->drawCommands, rhi::RESOURCE_USE_INDIRECT_READ);
+    rhi::SplitTransition(indirectDraw->culled, indirectDraw->drawCount, rhi::RESOURCE_USE_INDIRECT_READ);
+    rhi::SignalSplitBarrier(cmd, indirectDraw->culled);
+}
+
+void WaitCulledInstances(rhi::CommandBuffer* cmd, IndirectDraw* indirectDraw)
+{
+    if (indirectDraw->culled == nullptr)
+    {
+        return;
+    }
+    rhi::WaitSplitBarrier(cmd, indirectDraw->culled);
+    indirectDraw->culled = nullptr;
+}
+
+void DrawInstances(rhi::CommandBuffer* cmd,
+                   const IndirectDraw* indirectDraw,
+                   const rhi::Buffer* indexBuffer,
+                   VkIndexType indexType,
+                   VkDeviceSize indexBufferOffset)
+{
+    assert(indirectDraw->culled == nullptr && "WaitCulledInstances must be recorded before the render pass");
+    rhi::CmdBindIndexBuffer(cmd, indexBuffer, indexBufferOffset, indexType);
+    rhi::CmdDrawIndexedIndirectCount(cmd,
+                                     indirectDraw->drawCommands, 0,
+                                     indirectDraw->drawCount, 0,
+                                     indirectDraw->maxDrawCount);
+}
+} // namespace renderer
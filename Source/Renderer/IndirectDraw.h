@@ -0,0 +1,92 @@
+#pragma once
+
+#include "RHI/RHI.h"
+
+namespace renderer
+{
+// Layouts mirror Shaders/CullInstances.comp
+struct GpuInstance
+{
+    float boundingSphere[4]; // world space center and radius
+    uint32_t meshIndex;
+    uint32_t padding[3];
+};
+
+struct GpuMeshDraw
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+
+// The Hi-Z pyramid is a max-depth mip chain stored linearly in a storage buffer,
+// mip i starts at hizMipOffsets[i] floats and is (hizSize >> i) texels wide.
+// Mirrors Shaders/Culling.glsl.
+struct CullView
+{
+    float frustumPlanes[6][4];
+    float viewProj[16];
+    float hizSize[2];
+    uint32_t hizMipCount;
+    uint32_t padding0;
+    uint32_t hizMipOffsets[16];
+    // World space, for meshlet cone culling
+    float cameraPosition[3];
+    uint32_t padding1;
+};
+
+struct IndirectDrawDesc
+{
+    const rhi::Shader* cullShader;
+    uint32_t maxDrawCount;
+    // Capacity of the per-frame instance buffers written by WriteInstances, 0 when instances are supplied by the caller
+    uint32_t maxInstanceCount;
+};
+
+struct IndirectDraw
+{
+    rhi::Pipeline* cullPipeline;
+
+    // This frame's CullView in transient memory, written by CullInstances, 0 when it ran out of room
+    VkDeviceAddress view;
+    rhi::Buffer* drawCommands;
+    rhi::Buffer* drawCount;
+    uint32_t maxDrawCount;
+    // One per frame in flight, rewritten by the host every frame so they prefer the resizable BAR
+    rhi::Buffer* instances[MAX_FRAMES_IN_FLIGHT];
+    uint32_t maxInstanceCount;
+    // Signaled by CullInstances, null once WaitCulledInstances recorded the wait
+    rhi::SplitBarrier* culled;
+};
+
+IndirectDraw* CreateIndirectDraw(const IndirectDrawDesc& desc);
+void DestroyIndirectDraw(IndirectDraw* indirectDraw);
+
+// Writes this frame's instances, in place when the buffer landed in the resizable BAR and through the staging ring
+// recorded on cmd otherwise. Returns the buffer to pass to CullInstances, null when the staging ring is full.
+const rhi::Buffer* WriteInstances(rhi::CommandBuffer* cmd, IndirectDraw* indirectDraw, std::span<const GpuInstance> instances);
+
+// Resets the draw count and culls every instance into compacted draw commands.
+// Records outside of a render pass; hiz may be null to skip occlusion culling.
+// The transition to indirect reads is split: it is signaled here and waited by WaitCulledInstances.
+void CullInstances(rhi::CommandBuffer* cmd,
+                   IndirectDraw* indirectDraw,
+                   const CullView& view,
+                   const rhi::Buffer* instances,
+                   uint32_t instanceCount,
+                   const rhi::Buffer* meshDraws,
+                   const rhi::Buffer* hiz);
+
+// Waits for the culled draws as late as possible, right before the render pass that draws them.
+// Same queue as CullInstances, outside of a render pass.
+void WaitCulledInstances(rhi::CommandBuffer* cmd, IndirectDraw* indirectDraw);
+
+// Issues every surviving instance with a single vkCmdDrawIndexedIndirectCount.
+// The graphics pipeline must be bound, gl_InstanceIndex is the GpuInstance index. Requires WaitCulledInstances.
+void DrawInstances(rhi::CommandBuffer* cmd,
+                   const IndirectDraw* indirectDraw,
+                   const rhi::Buffer* indexBuffer,
+                   VkIndexType indexType = VK_INDEX_TYPE_UINT32,
+                   VkDeviceSize indexBufferOffset = 0);
+} // namespace renderer
@@ -0,0 +1,421 @@
+#include "MeshBuilder.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace renderer
+{
+struct Vec3
+{
+    float x;
+    float y;
+    float z;
+};
+
+static Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+static Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+static Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+static float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static Vec3 Cross(Vec3 a, Vec3 b) { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+static float Length(Vec3 a) { return sqrtf(Dot(a, a)); }
+static float Component(Vec3 a, uint32_t axis) { return axis == 0 ? a.x : axis == 1 ? a.y : a.z; }
+
+// Ritter's sphere: spans the most distant pair of axis extremes, then grows to enclose every point
+static void ComputeBoundingSphere(std::span<const Vec3> points, float sphere[4])
+{
+    if (points.empty())
+    {
+        std::fill_n(sphere, 4, 0.0f);
+        return;
+    }
+
+    uint32_t minIndices[3] = {};
+    uint32_t maxIndices[3] = {};
+    for (uint32_t i = 0; i < points.size(); ++i)
+    {
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            if (Component(points[i], axis) < Component(points[minIndices[axis]], axis))
+            {
+                minIndices[axis] = i;
+            }
+            if (Component(points[i], axis) > Component(points[maxIndices[axis]], axis))
+            {
+                maxIndices[axis] = i;
+            }
+        }
+    }
+
+    uint32_t spanAxis = 0;
+    float spanLength = 0.0f;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        float length = Length(points[maxIndices[axis]] - points[minIndices[axis]]);
+        if (length > spanLength)
+        {
+            spanLength = length;
+            spanAxis = axis;
+        }
+    }
+
+    Vec3 center = (points[minIndices[spanAxis]] + points[maxIndices[spanAxis]]) * 0.5f;
+    float radius = spanLength * 0.5f;
+    for (Vec3 point : points)
+    {
+        float distance = Length(point - center);
+        if (distance > radius)
+        {
+            float grownRadius = (radius + distance) * 0.5f;
+            center = center + (point - center) * ((grownRadius - radius) / distance);
+            radius = grownRadius;
+        }
+    }
+
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+}
+
+// Picks the next fanning vertex: the candidate that stays in the cache the longest while its remaining
+// triangles are emitted, else the most recent vertex with triangles left, else the next in index order.
+static uint32_t GetNextVertex(std::span<const uint32_t> candidates,
+                              std::span<const uint32_t> liveTriangles,
+                              std::span<const uint32_t> cacheTimes,
+                              uint32_t time,
+                              uint32_t cacheSize,
+                              std::vector<uint32_t>& deadEnds,
+                              uint32_t& cursor)
+{
+    uint32_t best = UINT32_MAX;
+    int64_t bestPriority = -1;
+    for (uint32_t vertex : candidates)
+    {
+        if (liveTriangles[vertex] == 0)
+        {
+            continue;
+        }
+
+        int64_t priority = 0;
+        if (time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+        {
+            priority = time - cacheTimes[vertex];
+        }
+        if (priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = vertex;
+        }
+    }
+    if (best != UINT32_MAX)
+    {
+        return best;
+    }
+
+    while (!deadEnds.empty())
+    {
+        uint32_t vertex = deadEnds.back();
+        deadEnds.pop_back();
+        if (liveTriangles[vertex] > 0)
+        {
+            return vertex;
+        }
+    }
+
+    for (; cursor < liveTriangles.size(); ++cursor)
+    {
+        if (liveTriangles[cursor] > 0)
+        {
+            return cursor;
+        }
+    }
+    return UINT32_MAX;
+}
+
+void OptimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles of every vertex, as offsets into one array
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indices.first(triangleCount * 3))
+    {
+        liveTriangles[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+    }
+    std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+        }
+    }
+
+    // A vertex is in the cache while time - cacheTime <= cacheSize
+    std::vector<uint32_t> cacheTimes(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+    uint32_t fanningVertex = indices[0];
+    while (fanningVertex != UINT32_MAX)
+    {
+        candidates.clear();
+        for (uint32_t i = adjacencyOffsets[fanningVertex]; i < adjacencyOffsets[fanningVertex + 1]; ++i)
+        {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+            emitted[triangle] = true;
+
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                if (time - cacheTimes[vertex] > cacheSize)
+                {
+                    cacheTimes[vertex] = time++;
+                }
+            }
+        }
+        fanningVertex = GetNextVertex(candidates, liveTriangles, cacheTimes, time, cacheSize, deadEnds, cursor);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+static void ComputeMeshletBounds(GpuMeshlet& meshlet,
+                                 std::span<const uint32_t> meshletVertices,
+                                 std::span<const uint32_t> meshletTriangles,
+                                 std::span<const Vec3> positions)
+{
+    Vec3 points[MESHLET_MAX_VERTICES];
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        points[i] = positions[meshletVertices[meshlet.vertexOffset + i]];
+    }
+    ComputeBoundingSphere(std::span(points, meshlet.vertexCount), meshlet.boundingSphere);
+    Vec3 center = {meshlet.boundingSphere[0], meshlet.boundingSphere[1], meshlet.boundingSphere[2]};
+
+    // Never culled unless a tighter cone is found below
+    meshlet.coneApex[0] = center.x;
+    meshlet.coneApex[1] = center.y;
+    meshlet.coneApex[2] = center.z;
+    meshlet.coneAxis[0] = 0.0f;
+    meshlet.coneAxis[1] = 0.0f;
+    meshlet.coneAxis[2] = 1.0f;
+    meshlet.coneCutoff = 2.0f;
+
+    Vec3 normals[MESHLET_MAX_TRIANGLES];
+    Vec3 corners[MESHLET_MAX_TRIANGLES];
+    uint32_t normalCount = 0;
+    Vec3 normalSum = {};
+    for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+    {
+        uint32_t triangle = meshletTriangles[meshlet.triangleOffset + i];
+        Vec3 p0 = points[triangle & 0xFF];
+        Vec3 p1 = points[(triangle >> 8) & 0xFF];
+        Vec3 p2 = points[(triangle >> 16) & 0xFF];
+        Vec3 normal = Cross(p1 - p0, p2 - p0);
+        float length = Length(normal);
+        if (length == 0.0f)
+        {
+            // Degenerate triangles are never visible
+            continue;
+        }
+        normals[normalCount] = normal * (1.0f / length);
+        corners[normalCount] = p0;
+        normalSum = normalSum + normals[normalCount];
+        ++normalCount;
+    }
+
+    float axisLength = Length(normalSum);
+    if (normalCount == 0 || axisLength == 0.0f)
+    {
+        return;
+    }
+    Vec3 axis = normalSum * (1.0f / axisLength);
+
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i < normalCount; ++i)
+    {
+        minDot = std::min(minDot, Dot(normals[i], axis));
+    }
+    if (minDot <= 0.0f)
+    {
+        // Normals span a hemisphere or more
+        return;
+    }
+
+    // Moves the apex back along the axis until it is behind every triangle's plane
+    float maxT = 0.0f;
+    for (uint32_t i = 0; i < normalCount; ++i)
+    {
+        float t = Dot(center - corners[i], normals[i]) / Dot(axis, normals[i]);
+        maxT = std::max(maxT, t);
+    }
+    Vec3 apex = center - axis * maxT;
+
+    meshlet.coneApex[0] = apex.x;
+    meshlet.coneApex[1] = apex.y;
+    meshlet.coneApex[2] = apex.z;
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    // The normal cone has a half angle of acos(minDot), the culling cone is its complement: sin(acos(minDot))
+    meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+// Fills meshlets greedily in triangle order, which after the cache optimization keeps neighbours together
+static void BuildMeshlets(std::span<const uint32_t> indices,
+                          std::span<const Vec3> positions,
+                          std::vector<GpuMeshlet>& meshlets,
+                          std::vector<uint32_t>& meshletVertices,
+                          std::vector<uint32_t>& meshletTriangles)
+{
+    std::vector<uint8_t> localIndices(positions.size(), UINT8_MAX);
+    GpuMeshlet meshlet = {};
+
+    auto finishMeshlet = [&]()
+    {
+        if (meshlet.triangleCount == 0)
+        {
+            return;
+        }
+        ComputeMeshletBounds(meshlet, meshletVertices, meshletTriangles, positions);
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            localIndices[meshletVertices[meshlet.vertexOffset + i]] = UINT8_MAX;
+        }
+        meshlets.push_back(meshlet);
+
+        meshlet = {};
+        meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+    };
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t a = indices[i];
+        uint32_t b = indices[i + 1];
+        uint32_t c = indices[i + 2];
+        uint32_t newVertexCount = (localIndices[a] == UINT8_MAX) +
+                                  (localIndices[b] == UINT8_MAX && b != a) +
+                                  (localIndices[c] == UINT8_MAX && c != a && c != b);
+        if (meshlet.vertexCount + newVertexCount > MESHLET_MAX_VERTICES || meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+        {
+            finishMeshlet();
+        }
+
+        uint32_t triangle = 0;
+        uint32_t corners[3] = {a, b, c};
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            uint32_t vertex = corners[corner];
+            if (localIndices[vertex] == UINT8_MAX)
+            {
+                localIndices[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+                meshletVertices.push_back(vertex);
+            }
+            triangle |= static_cast<uint32_t>(localIndices[vertex]) << (8 * corner);
+        }
+        meshletTriangles.push_back(triangle);
+        meshlet.triangleCount++;
+    }
+    finishMeshlet();
+}
+
+template <typename T>
+static uint64_t AppendSection(std::vector<uint8_t>& blob, const std::vector<T>& section)
+{
+    blob.resize((blob.size() + MESH_SECTION_ALIGNMENT - 1) & ~size_t(MESH_SECTION_ALIGNMENT - 1));
+    uint64_t offset = blob.size();
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(section.data());
+    blob.insert(blob.end(), data, data + section.size() * sizeof(T));
+    return offset;
+}
+
+void BuildMesh(std::span<const MeshVertex> vertices, std::span<const uint32_t> indices, std::vector<uint8_t>& blob)
+{
+    std::vector<uint32_t> optimizedIndices(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    OptimizeVertexCache(optimizedIndices, static_cast<uint32_t>(vertices.size()));
+
+    // Renumbers vertices in first use order, so vertex fetches walk memory forward
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vec3> positions;
+    std::vector<uint8_t> packedVertices;
+    for (uint32_t& index : optimizedIndices)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = static_cast<uint32_t>(positions.size());
+
+            const MeshVertex& vertex = vertices[index];
+            packedVertices.resize(packedVertices.size() + MeshVertexLayout::stride);
+            MeshVertexLayout::Pack(packedVertices.data() + packedVertices.size() - MeshVertexLayout::stride,
+                                   vertex.position, vertex.normal, vertex.uv);
+            positions.push_back({vertex.position[0], vertex.position[1], vertex.position[2]});
+        }
+        index = remap[index];
+    }
+
+    std::vector<GpuMeshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    BuildMeshlets(optimizedIndices, positions, meshlets, meshletVertices, meshletTriangles);
+
+    MeshHeader header = {};
+    header.magic = MESH_MAGIC;
+    header.version = MESH_VERSION;
+    header.vertexCount = static_cast<uint32_t>(positions.size());
+    header.indexCount = static_cast<uint32_t>(optimizedIndices.size());
+    header.meshletCount = static_cast<uint32_t>(meshlets.size());
+    header.meshletVertexCount = static_cast<uint32_t>(meshletVertices.size());
+    header.meshletTriangleCount = static_cast<uint32_t>(meshletTriangles.size());
+    ComputeBoundingSphere(positions, header.boundingSphere);
+
+    blob.assign(sizeof(MeshHeader), 0);
+    header.vertexOffset = AppendSection(blob, packedVertices);
+    header.indexOffset = AppendSection(blob, optimizedIndices);
+    header.meshletOffset = AppendSection(blob, meshlets);
+    header.meshletVertexOffset = AppendSection(blob, meshletVertices);
+    header.meshletTriangleOffset = AppendSection(blob, meshletTriangles);
+    memcpy(blob.data(), &header, sizeof(header));
+}
+
+const MeshHeader* GetMeshHeader(std::span<const uint8_t> blob)
+{
+    if (blob.size() < sizeof(MeshHeader))
+    {
+        return nullptr;
+    }
+
+    const MeshHeader* header = reinterpret_cast<const MeshHeader*>(blob.data());
+    if (header->magic != MESH_MAGIC || header->version != MESH_VERSION ||
+        header->meshletTriangleOffset + header->meshletTriangleCount * sizeof(uint32_t) > blob.size())
+    {
+        return nullptr;
+    }
+    return header;
+}
+} // namespace renderer
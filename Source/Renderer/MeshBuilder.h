@@ -0,0 +1,76 @@
+#pragma once
+
+#include "RHI/VertexLayout.h"
+
+#define MESH_MAGIC 0x48534D42 // "BMSH"
+#define MESH_VERSION 1
+// Meshlet limits, 124 triangles keeps the triangle section a multiple of 4 and the output fits every mesh shading device
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// Every section of a mesh blob starts on this boundary
+#define MESH_SECTION_ALIGNMENT 16
+
+namespace renderer
+{
+// Input of BuildMesh, 32 bytes
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+// Layouts mirror Shaders/Mesh.glsl
+
+// Positions stay full precision for large scenes, the normal is octahedral encoded into two snorm16
+// and the uv is two halfs: 20 bytes per vertex instead of 32.
+using MeshVertexLayout = rhi::VertexLayout<rhi::VertexFloat3, rhi::VertexOctahedralNormal, rhi::VertexHalf2>;
+
+// Every triangle of the meshlet faces away from any point p with dot(normalize(coneApex - p), coneAxis) >= coneCutoff.
+// coneCutoff is above 1 when the triangles spread too wide to ever be culled together.
+struct GpuMeshlet
+{
+    float boundingSphere[4];
+    float coneApex[3];
+    float coneCutoff;
+    float coneAxis[3];
+    // First entry in the meshlet vertex and triangle sections
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t padding;
+};
+
+// Blob of a mesh asset written by BuildMesh, uploaded as is into one buffer. Offsets are bytes from the blob start:
+// - vertices: MeshVertexLayout, in first use order
+// - indices: uint32 triangle list in vertex cache order, drawn by the vertex shader path
+// - meshlets: GpuMeshlet, in the same triangle order
+// - meshlet vertices: uint32 indices into vertices
+// - meshlet triangles: one uint32 per triangle, three 8-bit indices into the meshlet's vertices
+struct MeshHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t meshletTriangleCount;
+    uint32_t padding;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t meshletOffset;
+    uint64_t meshletVertexOffset;
+    uint64_t meshletTriangleOffset;
+    float boundingSphere[4];
+};
+
+// Reorders the triangles of a triangle list for the post-transform vertex cache (Tipsify), in place.
+void OptimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+// Optimizes vertex cache and fetch order, splits the triangles into meshlets with culling bounds
+// and quantizes the vertices, see MeshHeader. Unreferenced vertices are dropped.
+void BuildMesh(std::span<const MeshVertex> vertices, std::span<const uint32_t> indices, std::vector<uint8_t>& blob);
+// Returns null if the blob was not written by BuildMesh
+const MeshHeader* GetMeshHeader(std::span<const uint8_t> blob);
+} // namespace renderer
@@ -0,0 +1,83 @@
+#include "MeshletDraw.h"
+
+namespace renderer
+{
+struct MeshletPushConstants
+{
+    VkDeviceAddress vertices;
+    VkDeviceAddress meshlets;
+    VkDeviceAddress meshletVertices;
+    VkDeviceAddress meshletTriangles;
+    VkDeviceAddress view;
+    VkDeviceAddress hiz;
+    uint32_t meshletCount;
+    uint32_t occlusionCulling;
+};
+
+MeshletDraw* CreateMeshletDraw(const MeshletDrawDesc& desc)
+{
+    if (!rhi::IsMeshShaderSupported())
+    {
+        return nullptr;
+    }
+
+    MeshletDraw* meshletDraw = new MeshletDraw();
+
+    rhi::GraphicsPipelineDesc pipelineDesc = {};
+    pipelineDesc.taskShader = desc.taskShader;
+    pipelineDesc.meshShader = desc.meshShader;
+    pipelineDesc.fragmentShader = desc.fragmentShader;
+    pipelineDesc.colorFormats = desc.colorFormats;
+    pipelineDesc.depthFormat = desc.depthFormat;
+    meshletDraw->pipeline = rhi::CreateGraphicsPipelineAsync(pipelineDesc);
+
+    return meshletDraw;
+}
+
+void DestroyMeshletDraw(MeshletDraw* meshletDraw)
+{
+    if (meshletDraw == nullptr)
+    {
+        return;
+    }
+
+    rhi::DestroyPipeline(meshletDraw->pipeline);
+    delete meshletDraw;
+}
+
+void SetMeshletView(MeshletDraw* meshletDraw, const CullView& view)
+{
+    rhi::TransientAllocation allocation = rhi::WriteTransient(view);
+    if (allocation.data == nullptr)
+    {
+        LOGW("Out of transient memory, meshlets are not drawn this frame.\n");
+    }
+    meshletDraw->view = allocation.data != nullptr ? allocation.deviceAddress : 0;
+}
+
+void DrawMeshlets(rhi::CommandBuffer* cmd,
+                  const MeshletDraw* meshletDraw,
+                  const rhi::Buffer* mesh,
+                  const MeshHeader& header,
+                  const rhi::Buffer* hiz)
+{
+    // No view when SetMeshletView ran out of transient memory
+    if (header.meshletCount == 0 || meshletDraw->view == 0 || !rhi::CmdBindPipeline(cmd, meshletDraw->pipeline))
+    {
+        return;
+    }
+
+    MeshletPushConstants pushConstants = {};
+    pushConstants.vertices = mesh->deviceAddress + header.vertexOffset;
+    pushConstants.meshlets = mesh->deviceAddress + header.meshletOffset;
+    pushConstants.meshletVertices = mesh->deviceAddress + header.meshletVertexOffset;
+    pushConstants.meshletTriangles = mesh->deviceAddress + header.meshletTriangleOffset;
+    pushConstants.view = meshletDraw->view;
+    pushConstants.hiz = hiz != nullptr ? hiz->deviceAddress : 0;
+    pushConstants.meshletCount = header.meshletCount;
+    pushConstants.occlusionCulling = hiz != nullptr ? 1 : 0;
+
+    rhi::CmdPushConstants(cmd, pushConstants);
+    rhi::CmdDrawMeshTasks(cmd, (header.meshletCount + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK);
+}
+} // namespace renderer
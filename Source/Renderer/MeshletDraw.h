@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Renderer/IndirectDraw.h"
+#include "Renderer/MeshBuilder.h"
+
+// Meshlets culled by one task shader workgroup, matches Shaders/Mesh.glsl
+#define MESHLETS_PER_TASK 32
+
+namespace renderer
+{
+// Draws mesh blobs written by BuildMesh with task and mesh shaders: Shaders/Meshlet.task culls every
+// meshlet on the GPU against the frustum, its normal cone and the Hi-Z pyramid, Shaders/Meshlet.mesh emits the survivors.
+//
+// Without VK_EXT_mesh_shader, CreateMeshletDraw returns null and meshes go through IndirectDraw instead:
+// cull instances with CullInstances and WaitCulledInstances, bind a pipeline with Shaders/Mesh.vert and
+// SetVertexLayout<MeshVertexLayout>, push MeshVertexPushConstants, bind the blob's vertex section at header.vertexOffset
+// with CmdBindVertexBuffer and call DrawInstances with its index section at header.indexOffset.
+// The mesh buffer then needs vertex and index usage.
+struct MeshletDrawDesc
+{
+    const rhi::Shader* taskShader;
+    const rhi::Shader* meshShader;
+    const rhi::Shader* fragmentShader;
+
+    std::span<const VkFormat> colorFormats;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+struct MeshletDraw
+{
+    rhi::Pipeline* pipeline;
+    // This frame's CullView in transient memory, written by SetMeshletView, 0 when it ran out of room
+    VkDeviceAddress view;
+};
+
+// Push constants of Shaders/Mesh.vert, view is IndirectDraw::view
+struct MeshVertexPushConstants
+{
+    VkDeviceAddress view;
+};
+
+// Returns null when mesh shaders are unsupported
+MeshletDraw* CreateMeshletDraw(const MeshletDrawDesc& desc);
+void DestroyMeshletDraw(MeshletDraw* meshletDraw);
+
+// Once per frame before any DrawMeshlets
+void SetMeshletView(MeshletDraw* meshletDraw, const CullView& view);
+// Binds the pipeline and launches one task shader workgroup per MESHLETS_PER_TASK meshlets.
+// mesh holds the whole blob, header is read from its source; hiz may be null to skip occlusion culling.
+void DrawMeshlets(rhi::CommandBuffer* cmd,
+                  const MeshletDraw* meshletDraw,
+                  const rhi::Buffer* mesh,
+                  const MeshHeader& header,
+                  const rhi::Buffer* hiz);
+} // namespace renderer
@@ -0,0 +1,451 @@
+#include "TextureStreaming.h"
+#include "Foundation/JobSystem.h"
+
+#include <string.h>
+
+// Matches the reset value in Shaders/TextureFeedback.glsl
+#define FEEDBACK_UNSAMPLED UINT32_MAX
+// Frames a texture may go unsampled before its mips become eviction candidates
+#define EVICTION_DELAY_FRAMES 120
+// Mip data is read ahead by at most this many frames worth of upload budget
+#define MAX_LOADING_BUDGET_FACTOR 4
+// Buffer to image copies need offsets aligned to the texel block size
+#define STAGING_ALIGNMENT 16
+
+namespace renderer
+{
+struct TextureStreamer
+{
+    TextureStreamerDesc desc;
+
+    // Indexed by feedback id, null for free ids
+    std::vector<StreamingTexture*> textures;
+    std::vector<uint32_t> freeIds;
+
+    // Written by shaders during a frame, read back once that frame retires
+    rhi::Buffer* feedback[MAX_FRAMES_IN_FLIGHT];
+    bool feedbackValid[MAX_FRAMES_IN_FLIGHT];
+    rhi::Buffer* staging[MAX_FRAMES_IN_FLIGHT];
+
+    VkDeviceSize loadingBytes;
+    jobsystem::Counter counter;
+};
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static VkDeviceSize GetMipDataSize(const StreamingTextureDesc& desc, uint32_t mip)
+{
+    return AlignUp(rhi::GetTextureDataSize(desc.format, std::max(desc.width >> mip, 1u), std::max(desc.height >> mip, 1u)), STAGING_ALIGNMENT);
+}
+
+// Staged size of mips [firstMip, mipCount), also the estimate of the texture's device memory
+static VkDeviceSize GetMipRangeSize(const StreamingTextureDesc& desc, uint32_t firstMip)
+{
+    VkDeviceSize size = 0;
+    for (uint32_t mip = firstMip; mip < desc.mipCount; ++mip)
+    {
+        size += GetMipDataSize(desc, mip);
+    }
+    return size;
+}
+
+// Device memory the texture will occupy once its pending load is uploaded
+static VkDeviceSize GetProjectedSize(const StreamingTexture* texture)
+{
+    if (texture->loadMip != UINT32_MAX)
+    {
+        return GetMipRangeSize(texture->desc, texture->loadMip);
+    }
+    return texture->texture != nullptr ? texture->texture->size : 0;
+}
+
+static uint32_t GetDesiredMip(const StreamingTexture* texture, uint64_t frameCount)
+{
+    if (texture->lastSampledFrame + EVICTION_DELAY_FRAMES < frameCount)
+    {
+        return texture->tailMip;
+    }
+    return texture->requestedMip;
+}
+
+static void LoadMips(StreamingTexture* texture, uint32_t firstMip)
+{
+    texture->loadData.resize(GetMipRangeSize(texture->desc, firstMip));
+
+    VkDeviceSize offset = 0;
+    for (uint32_t mip = firstMip; mip < texture->desc.mipCount; ++mip)
+    {
+        VkDeviceSize size = GetMipDataSize(texture->desc, mip);
+        VkDeviceSize dataSize = rhi::GetTextureDataSize(texture->desc.format,
+                                                        std::max(texture->desc.width >> mip, 1u),
+                                                        std::max(texture->desc.height >> mip, 1u));
+        if (!texture->desc.readMip(mip, std::span(texture->loadData.data() + offset, dataSize)))
+        {
+            // An empty load is dropped on upload
+            texture->loadData.clear();
+            break;
+        }
+        offset += size;
+    }
+    texture->loaded.store(true, std::memory_order_release);
+}
+
+static void StartLoad(TextureStreamer* streamer, StreamingTexture* texture, uint32_t firstMip)
+{
+    texture->loadMip = firstMip;
+    texture->loaded.store(false, std::memory_order_relaxed);
+    streamer->loadingBytes += GetMipRangeSize(texture->desc, firstMip);
+
+    if (jobsystem::GetThreadCount() <= 1)
+    {
+        // No worker would pick the job up before the next wait
+        LoadMips(texture, firstMip);
+        return;
+    }
+    jobsystem::Execute(streamer->counter, [texture, firstMip](jobsystem::JobArgs) { LoadMips(texture, firstMip); });
+}
+
+static void FinishLoad(TextureStreamer* streamer, StreamingTexture* texture)
+{
+    streamer->loadingBytes -= GetMipRangeSize(texture->desc, texture->loadMip);
+    texture->loadMip = UINT32_MAX;
+    std::vector<uint8_t>().swap(texture->loadData);
+}
+
+TextureStreamer* CreateTextureStreamer(const TextureStreamerDesc& desc)
+{
+    TextureStreamer* streamer = new TextureStreamer();
+    streamer->desc = desc;
+    streamer->loadingBytes = 0;
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        rhi::BufferDesc feedbackDesc = {};
+        feedbackDesc.size = sizeof(uint32_t) * 2 * desc.maxTextureCount;
+        feedbackDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+        feedbackDesc.bufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        streamer->feedback[i] = rhi::CreateBuffer(feedbackDesc);
+        streamer->feedbackValid[i] = false;
+
+        rhi::BufferDesc stagingDesc = {};
+        stagingDesc.size = desc.uploadBudget;
+        stagingDesc.memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY;
+        stagingDesc.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        stagingDesc.category = rhi::MEMORY_CATEGORY_STAGING;
+        streamer->staging[i] = rhi::CreateBuffer(stagingDesc);
+    }
+    return streamer;
+}
+
+void DestroyTextureStreamer(TextureStreamer* streamer)
+{
+    if (streamer == nullptr)
+    {
+        return;
+    }
+
+    jobsystem::Wait(streamer->counter);
+    for (StreamingTexture* texture : streamer->textures)
+    {
+        DestroyStreamingTexture(streamer, texture);
+    }
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        rhi::DestroyBuffer(streamer->feedback[i]);
+        rhi::DestroyBuffer(streamer->staging[i]);
+    }
+    delete streamer;
+}
+
+StreamingTexture* CreateStreamingTexture(TextureStreamer* streamer, const StreamingTextureDesc& desc)
+{
+    uint32_t id = (uint32_t)streamer->textures.size();
+    if (!streamer->freeIds.empty())
+    {
+        id = streamer->freeIds.back();
+        streamer->freeIds.pop_back();
+    }
+    else if (id < streamer->desc.maxTextureCount)
+    {
+        streamer->textures.push_back(nullptr);
+    }
+    else
+    {
+        LOGE("Streaming texture count exceeds %u.\n", streamer->desc.maxTextureCount);
+        return nullptr;
+    }
+
+    StreamingTexture* texture = new StreamingTexture();
+    texture->id = id;
+    texture->desc = desc;
+    texture->texture = nullptr;
+    texture->residentMip = desc.mipCount;
+    texture->tailMip = desc.mipCount - 1;
+    while (texture->tailMip > 0 &&
+           std::max(desc.width >> (texture->tailMip - 1), desc.height >> (texture->tailMip - 1)) <= streamer->desc.tailSize)
+    {
+        texture->tailMip--;
+    }
+    texture->requestedMip = texture->tailMip;
+    texture->coverage = 0;
+    texture->lastSampledFrame = 0;
+    texture->loadMip = UINT32_MAX;
+    streamer->textures[id] = texture;
+
+    StartLoad(streamer, texture, texture->tailMip);
+    return texture;
+}
+
+void DestroyStreamingTexture(TextureStreamer* streamer, StreamingTexture* texture)
+{
+    if (texture == nullptr)
+    {
+        return;
+    }
+
+    if (texture->loadMip != UINT32_MAX)
+    {
+        while (!texture->loaded.load(std::memory_order_acquire))
+        {
+            jobsystem::Wait(streamer->counter);
+        }
+        FinishLoad(streamer, texture);
+    }
+
+    streamer->textures[texture->id] = nullptr;
+    streamer->freeIds.push_back(texture->id);
+    rhi::DestroyTexture(texture->texture);
+    delete texture;
+}
+
+static void ReadFeedback(TextureStreamer* streamer, uint32_t frameIndex)
+{
+    rhi::Buffer* feedback = streamer->feedback[frameIndex];
+    if (streamer->feedbackValid[frameIndex])
+    {
+        rhi::InvalidateBuffer(feedback);
+        const uint32_t* requiredMips = static_cast<const uint32_t*>(feedback->mappedData);
+        const uint32_t* coverage = requiredMips + streamer->desc.maxTextureCount;
+        uint64_t frameCount = rhi::GetFrameCount();
+
+        for (StreamingTexture* texture : streamer->textures)
+        {
+            if (texture == nullptr)
+            {
+                continue;
+            }
+
+            if (requiredMips[texture->id] != FEEDBACK_UNSAMPLED)
+            {
+                texture->requestedMip = std::min(requiredMips[texture->id], texture->tailMip);
+                texture->coverage = coverage[texture->id];
+                texture->lastSampledFrame = frameCount;
+            }
+            else
+            {
+                texture->coverage = 0;
+            }
+        }
+    }
+
+    // The buffer is reused by this frame's draws
+    rhi::CommandBuffer* cmd = rhi::GetCmdBuffer(rhi::QUEUE_GRAPHICS);
+    VkDeviceSize half = sizeof(uint32_t) * streamer->desc.maxTextureCount;
+    rhi::CmdFillBuffer(cmd, feedback, 0, half, FEEDBACK_UNSAMPLED);
+    rhi::CmdFillBuffer(cmd, feedback, half, half, 0);
+    rhi::CmdMemoryBarrier(cmd,
+                          VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                          VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                          VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    streamer->feedbackValid[frameIndex] = true;
+}
+
+static void ScheduleLoads(TextureStreamer* streamer)
+{
+    uint64_t frameCount = rhi::GetFrameCount();
+
+    VkDeviceSize projectedBytes = 0;
+    std::vector<StreamingTexture*> evictions;
+    std::vector<StreamingTexture*> loads;
+    for (StreamingTexture* texture : streamer->textures)
+    {
+        if (texture == nullptr)
+        {
+            continue;
+        }
+
+        projectedBytes += GetProjectedSize(texture);
+        if (texture->loadMip != UINT32_MAX)
+        {
+            continue;
+        }
+
+        uint32_t desiredMip = GetDesiredMip(texture, frameCount);
+        if (desiredMip > texture->residentMip)
+        {
+            evictions.push_back(texture);
+        }
+        else if (desiredMip < texture->residentMip)
+        {
+            loads.push_back(texture);
+        }
+    }
+
+    // Under memory pressure, textures left unsampled the longest drop their extra mips first.
+    // Eviction rebuilds the texture from its smaller mip chain, which is cheap compared to the mips it frees.
+    if (projectedBytes > streamer->desc.residencyBudget)
+    {
+        std::sort(evictions.begin(), evictions.end(),
+                  [](const StreamingTexture* a, const StreamingTexture* b) { return a->lastSampledFrame < b->lastSampledFrame; });
+        for (StreamingTexture* texture : evictions)
+        {
+            if (projectedBytes <= streamer->desc.residencyBudget)
+            {
+                break;
+            }
+
+            uint32_t desiredMip = GetDesiredMip(texture, frameCount);
+            projectedBytes -= GetProjectedSize(texture);
+            projectedBytes += GetMipRangeSize(texture->desc, desiredMip);
+            StartLoad(streamer, texture, desiredMip);
+        }
+    }
+
+    // Largest on screen first
+    std::sort(loads.begin(), loads.end(),
+              [](const StreamingTexture* a, const StreamingTexture* b) { return a->coverage > b->coverage; });
+    for (StreamingTexture* texture : loads)
+    {
+        if (streamer->loadingBytes >= MAX_LOADING_BUDGET_FACTOR * streamer->desc.uploadBudget)
+        {
+            break;
+        }
+
+        uint32_t desiredMip = GetDesiredMip(texture, frameCount);
+        VkDeviceSize grownBytes = projectedBytes - GetProjectedSize(texture) + GetMipRangeSize(texture->desc, desiredMip);
+        if (grownBytes > streamer->desc.residencyBudget)
+        {
+            continue;
+        }
+
+        projectedBytes = grownBytes;
+        StartLoad(streamer, texture, desiredMip);
+    }
+}
+
+static void UploadTexture(TextureStreamer* streamer, StreamingTexture* texture, rhi::Buffer* staging, VkDeviceSize stagingOffset)
+{
+    memcpy(static_cast<uint8_t*>(staging->mappedData) + stagingOffset, texture->loadData.data(), texture->loadData.size());
+
+    rhi::TextureDesc textureDesc = {};
+    textureDesc.width = std::max(texture->desc.width >> texture->loadMip, 1u);
+    textureDesc.height = std::max(texture->desc.height >> texture->loadMip, 1u);
+    textureDesc.mipLevels = texture->desc.mipCount - texture->loadMip;
+    textureDesc.format = texture->desc.format;
+    textureDesc.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    rhi::Texture* uploaded = rhi::CreateTexture(textureDesc);
+
+    rhi::CommandBuffer* cmd = rhi::GetCmdBuffer(rhi::QUEUE_COPY);
+    rhi::Transition(cmd, uploaded, rhi::RESOURCE_USE_TRANSFER_WRITE);
+    VkDeviceSize offset = stagingOffset;
+    for (uint32_t mip = 0; mip < textureDesc.mipLevels; ++mip)
+    {
+        rhi::CmdCopyBufferToTexture(cmd, staging, offset, uploaded, mip);
+        offset += GetMipDataSize(texture->desc, texture->loadMip + mip);
+    }
+    // The graphics queue waits for the copy submission before any of this frame's draws
+    rhi::Transition(cmd, uploaded, rhi::RESOURCE_USE_GRAPHICS_READ);
+
+    // Draws recorded earlier this frame may still sample the old image, it is released with the frame
+    rhi::DestroyTexture(texture->texture);
+    texture->texture = uploaded;
+    texture->residentMip = texture->loadMip;
+}
+
+static void UploadTextures(TextureStreamer* streamer, uint32_t frameIndex)
+{
+    std::vector<StreamingTexture*> ready;
+    for (StreamingTexture* texture : streamer->textures)
+    {
+        if (texture != nullptr && texture->loadMip != UINT32_MAX && texture->loaded.load(std::memory_order_acquire))
+        {
+            ready.push_back(texture);
+        }
+    }
+
+    std::sort(ready.begin(), ready.end(),
+              [](const StreamingTexture* a, const StreamingTexture* b) { return a->coverage > b->coverage; });
+
+    rhi::Buffer* staging = streamer->staging[frameIndex];
+    VkDeviceSize stagedBytes = 0;
+    for (StreamingTexture* texture : ready)
+    {
+        VkDeviceSize size = texture->loadData.size();
+        if (size == 0)
+        {
+            LOGE("Failed to read mips of streaming texture %u.\n", texture->id);
+            FinishLoad(streamer, texture);
+            continue;
+        }
+
+        if (size > streamer->desc.uploadBudget)
+        {
+            // Oversized uploads take the whole frame budget with a staging buffer of their own
+            if (stagedBytes > 0)
+            {
+                continue;
+            }
+
+            rhi::BufferDesc stagingDesc = {};
+            stagingDesc.size = size;
+            stagingDesc.memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY;
+            stagingDesc.bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            stagingDesc.category = rhi::MEMORY_CATEGORY_STAGING;
+            rhi::Buffer* oversized = rhi::CreateBuffer(stagingDesc);
+            UploadTexture(streamer, texture, oversized, 0);
+            rhi::DestroyBuffer(oversized);
+            FinishLoad(streamer, texture);
+            break;
+        }
+
+        if (stagedBytes + size > streamer->desc.uploadBudget)
+        {
+            continue;
+        }
+
+        UploadTexture(streamer, texture, staging, stagedBytes);
+        stagedBytes += size;
+        FinishLoad(streamer, texture);
+    }
+}
+
+void UpdateTextureStreamer(TextureStreamer* streamer)
+{
+    uint32_t frameIndex = rhi::GetFrameCount() % MAX_FRAMES_IN_FLIGHT;
+    ReadFeedback(streamer, frameIndex);
+    ScheduleLoads(streamer);
+    UploadTextures(streamer, frameIndex);
+}
+
+VkDeviceAddress GetTextureFeedbackAddress(const TextureStreamer* streamer)
+{
+    return streamer->feedback[rhi::GetFrameCount() % MAX_FRAMES_IN_FLIGHT]->deviceAddress;
+}
+
+VkDeviceSize GetStreamingResidentBytes(const TextureStreamer* streamer)
+{
+    VkDeviceSize residentBytes = 0;
+    for (const StreamingTexture* texture : streamer->textures)
+    {
+        if (texture != nullptr && texture->texture != nullptr)
+        {
+            residentBytes += texture->texture->size;
+        }
+    }
+    return residentBytes;
+}
+} // namespace renderer
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "RHI/RHI.h"
+
+#include <functional>
+
+namespace renderer
+{
+struct StreamingTextureDesc
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    VkFormat format;
+    // Fills dst with the tightly packed data of one mip, called from job system threads
+    std::function<bool(uint32_t mip, std::span<uint8_t> dst)> readMip;
+};
+
+struct TextureStreamerDesc
+{
+    uint32_t maxTextureCount = 4096;
+    // Bytes staged for upload per frame
+    VkDeviceSize uploadBudget = 32ull << 20;
+    // Device memory all streamed textures may occupy before mips get evicted
+    VkDeviceSize residencyBudget = 6ull << 30;
+    // Mips no larger than this stay resident, so every texture can always be sampled
+    uint32_t tailSize = 128;
+};
+
+struct StreamingTexture
+{
+    // Index into the feedback buffer, handed to shaders alongside the texture
+    uint32_t id;
+    StreamingTextureDesc desc;
+
+    // Holds mips [residentMip, mipCount), null until the tail is uploaded
+    rhi::Texture* texture;
+    uint32_t residentMip;
+    uint32_t tailMip;
+
+    // Latest feedback: finest mip sampled and sampled pixel count
+    uint32_t requestedMip;
+    uint32_t coverage;
+    uint64_t lastSampledFrame;
+
+    // Mips [loadMip, mipCount) read by a job into loadData, UINT32_MAX when idle
+    uint32_t loadMip;
+    std::atomic<bool> loaded;
+    std::vector<uint8_t> loadData;
+};
+
+struct TextureStreamer;
+
+TextureStreamer* CreateTextureStreamer(const TextureStreamerDesc& desc);
+void DestroyTextureStreamer(TextureStreamer* streamer);
+
+// Starts with only the mip tail resident, the texture is null until its first upload.
+StreamingTexture* CreateStreamingTexture(TextureStreamer* streamer, const StreamingTextureDesc& desc);
+void DestroyStreamingTexture(TextureStreamer* streamer, StreamingTexture* texture);
+
+// Call once per frame before recording draws that write feedback.
+// Reads back the feedback of the frame that just retired, starts loads for mips that were sampled,
+// evicts mips under memory pressure and records this frame's uploads on the copy queue.
+void UpdateTextureStreamer(TextureStreamer* streamer);
+
+// Feedback buffer of the current frame, see Shaders/TextureFeedback.glsl
+VkDeviceAddress GetTextureFeedbackAddress(const TextureStreamer* streamer);
+VkDeviceSize GetStreamingResidentBytes(const TextureStreamer* streamer);
+} // namespace renderer
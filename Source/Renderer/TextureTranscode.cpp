@@ -0,0 +1,288 @@
+#include "TextureTranscode.h"
+
+#include "Foundation/Compression.h"
+#include "Foundation/JobSystem.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define BLOCK_ROWS_PER_JOB 8
+
+namespace renderer
+{
+struct TranscodeMip
+{
+    const uint8_t* rgba;
+    uint8_t* blocks;
+    uint32_t width;
+    uint32_t height;
+    uint32_t blockCountX;
+    bool alpha;
+};
+
+VkDeviceSize GetPackedMipOffset(VkFormat format, uint32_t width, uint32_t height, uint32_t mip)
+{
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < mip; ++i)
+    {
+        VkDeviceSize size = rhi::GetTextureDataSize(format, std::max(width >> i, 1u), std::max(height >> i, 1u));
+        offset += (size + ASSET_MIP_ALIGNMENT - 1) & ~VkDeviceSize(ASSET_MIP_ALIGNMENT - 1);
+    }
+    return offset;
+}
+
+VkFormat GetTranscodeFormat(const asset::AssetEntry* entry)
+{
+    VkFormat source = static_cast<VkFormat>(entry->format);
+    bool srgb = source == VK_FORMAT_R8G8B8A8_SRGB;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    if (entry->flags & asset::ASSET_FLAG_OPAQUE)
+    {
+        format = srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    }
+    else
+    {
+        format = srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    }
+
+    if (rhi::IsFormatSupported(format, VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_2_TRANSFER_DST_BIT))
+    {
+        return format;
+    }
+    return source;
+}
+
+static uint16_t To565(const int color[3])
+{
+    return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 |
+                                 ((color[1] * 63 + 127) / 255) << 5 |
+                                 ((color[2] * 31 + 127) / 255));
+}
+
+static void From565(uint16_t value, int color[3])
+{
+    int r = (value >> 11) & 31;
+    int g = (value >> 5) & 63;
+    int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Reads a 4x4 block, texels past the edge of small mips repeat the last row and column
+static void LoadBlock(const TranscodeMip& mip, uint32_t blockX, uint32_t blockY, uint8_t block[16][4])
+{
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        uint32_t row = std::min(blockY * 4 + y, mip.height - 1);
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            uint32_t column = std::min(blockX * 4 + x, mip.width - 1);
+            memcpy(block[y * 4 + x], mip.rgba + (static_cast<size_t>(row) * mip.width + column) * 4, 4);
+        }
+    }
+}
+
+// Endpoints from the inset bounding box, with its diagonal flipped to follow the sign of the covariance
+static void EncodeColorBlock(const uint8_t block[16][4], uint8_t* dst)
+{
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            minColor[c] = std::min<int>(minColor[c], block[i][c]);
+            maxColor[c] = std::max<int>(maxColor[c], block[i][c]);
+        }
+    }
+
+    int center[3];
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+        center[c] = (minColor[c] + maxColor[c]) >> 1;
+    }
+
+    int covarianceRG = 0;
+    int covarianceRB = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        int r = block[i][0] - center[0];
+        covarianceRG += r * (block[i][1] - center[1]);
+        covarianceRB += r * (block[i][2] - center[2]);
+    }
+    if (covarianceRG < 0)
+    {
+        std::swap(minColor[1], maxColor[1]);
+    }
+    if (covarianceRB < 0)
+    {
+        std::swap(minColor[2], maxColor[2]);
+    }
+
+    uint16_t color0 = To565(maxColor);
+    uint16_t color1 = To565(minColor);
+    // color0 > color1 selects the four color mode, equal endpoints need no indices
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        From565(color0, palette[0]);
+        From565(color1, palette[1]);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t best = 0;
+            int bestDistance = INT32_MAX;
+            for (uint32_t p = 0; p < 4; ++p)
+            {
+                int dr = block[i][0] - palette[p][0];
+                int dg = block[i][1] - palette[p][1];
+                int db = block[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    memcpy(dst, &color0, sizeof(color0));
+    memcpy(dst + 2, &color1, sizeof(color1));
+    memcpy(dst + 4, &indices, sizeof(indices));
+}
+
+// Eight value mode between the block's alpha range
+static void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* dst)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        alpha0 = std::max<int>(alpha0, block[i][3]);
+        alpha1 = std::min<int>(alpha1, block[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        int palette[8] = {alpha0, alpha1};
+        for (int p = 2; p < 8; ++p)
+        {
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint64_t best = 0;
+            int bestDistance = INT32_MAX;
+            for (uint32_t p = 0; p < 8; ++p)
+            {
+                int distance = std::abs(block[i][3] - palette[p]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+
+    dst[0] = static_cast<uint8_t>(alpha0);
+    dst[1] = static_cast<uint8_t>(alpha1);
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        dst[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+static void EncodeBlockRow(const TranscodeMip& mip, uint32_t blockY)
+{
+    uint32_t blockSize = mip.alpha ? 16 : 8;
+    uint8_t* dst = mip.blocks + static_cast<size_t>(blockY) * mip.blockCountX * blockSize;
+    for (uint32_t blockX = 0; blockX < mip.blockCountX; ++blockX, dst += blockSize)
+    {
+        uint8_t block[16][4];
+        LoadBlock(mip, blockX, blockY, block);
+        if (mip.alpha)
+        {
+            EncodeAlphaBlock(block, dst);
+            EncodeColorBlock(block, dst + 8);
+        }
+        else
+        {
+            EncodeColorBlock(block, dst);
+        }
+    }
+}
+
+bool TranscodeTexture(const asset::AssetEntry* entry, std::span<const uint8_t> src, VkFormat format, std::span<uint8_t> dst)
+{
+    assert(entry->flags & asset::ASSET_FLAG_SUPERCOMPRESSED);
+    VkFormat source = static_cast<VkFormat>(entry->format);
+    assert(source == VK_FORMAT_R8G8B8A8_UNORM || source == VK_FORMAT_R8G8B8A8_SRGB);
+
+    VkDeviceSize sourceSize = GetPackedMipOffset(source, entry->width, entry->height, entry->mipCount);
+    VkDeviceSize size = GetPackedMipOffset(format, entry->width, entry->height, entry->mipCount);
+    if (dst.size() < size)
+    {
+        return false;
+    }
+    if (format == source)
+    {
+        return compression::DecompressLZ(src, dst.first(sourceSize));
+    }
+
+    std::vector<uint8_t> rgba(sourceSize);
+    if (!compression::DecompressLZ(src, rgba))
+    {
+        return false;
+    }
+
+    bool alpha = format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK;
+    assert(alpha || format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK);
+
+    jobsystem::Counter counter;
+    for (uint32_t i = 0; i < entry->mipCount; ++i)
+    {
+        TranscodeMip mip = {};
+        mip.rgba = rgba.data() + GetPackedMipOffset(source, entry->width, entry->height, i);
+        mip.blocks = dst.data() + GetPackedMipOffset(format, entry->width, entry->height, i);
+        mip.width = std::max(entry->width >> i, 1u);
+        mip.height = std::max(entry->height >> i, 1u);
+        mip.blockCountX = (mip.width + 3) / 4;
+        mip.alpha = alpha;
+        uint32_t blockCountY = (mip.height + 3) / 4;
+
+        if (jobsystem::GetThreadCount() <= 1)
+        {
+            // The wait below would run every job on this thread anyway, encode directly and skip the job overhead
+            for (uint32_t blockY = 0; blockY < blockCountY; ++blockY)
+            {
+                EncodeBlockRow(mip, blockY);
+            }
+            continue;
+        }
+        jobsystem::Dispatch(counter, blockCountY, BLOCK_ROWS_PER_JOB, [mip](jobsystem::JobArgs args) { EncodeBlockRow(mip, args.jobIndex); });
+    }
+    jobsystem::Wait(counter);
+    return true;
+}
+} // namespace renderer
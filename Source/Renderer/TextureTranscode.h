@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Foundation/AssetPack.h"
+#include "RHI/RHI.h"
+
+namespace renderer
+{
+// Offset of a mip in a texture blob of the given format, mips are ASSET_MIP_ALIGNMENT aligned.
+// mip == mipCount gives the size of the whole chain.
+VkDeviceSize GetPackedMipOffset(VkFormat format, uint32_t width, uint32_t height, uint32_t mip);
+
+// Best format the device samples for a supercompressed texture: BC1 when opaque, BC3 otherwise,
+// and the uncompressed source format when block compression is unsupported.
+VkFormat GetTranscodeFormat(const asset::AssetEntry* entry);
+
+// Decompresses a supercompressed blob and block compresses every mip into dst, laid out like a texture blob
+// of the given format. Blocks are encoded on the job system, the calling thread helps until all are done.
+bool TranscodeTexture(const asset::AssetEntry* entry, std::span<const uint8_t> src, VkFormat format, std::span<uint8_t> dst);
+} // namespace renderer
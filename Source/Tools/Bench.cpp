@@ -0,0 +1,270 @@
+#include "Foundation/JobSystem.h"
+#include "Foundation/Log.h"
+#include "RHI/RHI.h"
+#include "RHI/VertexLayout.h"
+#include "Renderer/MeshBuilder.h"
+
+#include <chrono>
+#include <string.h>
+
+// Microbenchmarks of engine systems, each run by name and reported in ns per operation.
+//
+// Usage: BlastBench <benchmark> [iterations] [benchmark arguments]
+
+using Clock = std::chrono::steady_clock;
+
+static double GetElapsedNs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Spawn cost of single jobs, fan-out/fan-in of a wide dispatch, and jobs spawning jobs.
+// Spawning far more jobs than a thread has slots before waiting also exercises slot reuse.
+static bool BenchJobs(uint32_t iterations, std::span<char*>)
+{
+    jobsystem::Initialize();
+
+    const uint32_t spawnCount = 64 * 1024;
+    {
+        std::atomic<uint32_t> sum = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            jobsystem::Counter counter;
+            for (uint32_t j = 0; j < spawnCount; ++j)
+            {
+                jobsystem::Execute(counter, [&sum](jobsystem::JobArgs) { sum.fetch_add(1, std::memory_order_relaxed); });
+            }
+            jobsystem::Wait(counter);
+        }
+        double ns = GetElapsedNs(start);
+        if (sum.load() != iterations * spawnCount)
+        {
+            LOGE("Execute lost jobs: %u of %u ran.\n", sum.load(), iterations * spawnCount);
+        }
+        LOGI("Execute: %.1f ns per job.\n", ns / (double(iterations) * spawnCount));
+    }
+
+    const uint32_t dispatchCount = 1024 * 1024;
+    for (uint32_t groupSize : {1u, 64u, 1024u})
+    {
+        std::atomic<uint32_t> sum = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            jobsystem::Counter counter;
+            jobsystem::Dispatch(counter, dispatchCount, groupSize, [&sum](jobsystem::JobArgs) { sum.fetch_add(1, std::memory_order_relaxed); });
+            jobsystem::Wait(counter);
+        }
+        double ns = GetElapsedNs(start);
+        if (sum.load() != iterations * dispatchCount)
+        {
+            LOGE("Dispatch lost jobs: %u of %u ran.\n", sum.load(), iterations * dispatchCount);
+        }
+        LOGI("Dispatch, groups of %u: %.2f ns per invocation, %.0f us per fan-out/fan-in.\n",
+             groupSize, ns / (double(iterations) * dispatchCount), ns / iterations / 1e3);
+    }
+
+    const uint32_t parentCount = 256;
+    const uint32_t childCount = 256;
+    {
+        std::atomic<uint32_t> sum = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            jobsystem::Counter counter;
+            jobsystem::Dispatch(counter, parentCount, 1, [&sum, childCount](jobsystem::JobArgs) {
+                jobsystem::Counter children;
+                for (uint32_t j = 0; j < childCount; ++j)
+                {
+                    jobsystem::Execute(children, [&sum](jobsystem::JobArgs) { sum.fetch_add(1, std::memory_order_relaxed); });
+                }
+                jobsystem::Wait(children);
+            });
+            jobsystem::Wait(counter);
+        }
+        double ns = GetElapsedNs(start);
+        if (sum.load() != iterations * parentCount * childCount)
+        {
+            LOGE("Nested spawn lost jobs: %u of %u ran.\n", sum.load(), iterations * parentCount * childCount);
+        }
+        LOGI("Nested spawn: %.1f ns per child job.\n", ns / (double(iterations) * parentCount * childCount));
+    }
+
+    LOGI("%u threads, %u iterations.\n", jobsystem::GetThreadCount(), iterations);
+    jobsystem::Shutdown();
+    return true;
+}
+
+static bool LoadSpirv(const char* path, std::vector<uint32_t>& spirv)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    spirv.resize(size > 0 ? size / sizeof(uint32_t) : 0);
+    bool read = size > 0 && size % sizeof(uint32_t) == 0 && fread(spirv.data(), sizeof(uint32_t), spirv.size(), file) == spirv.size();
+    fclose(file);
+    return read;
+}
+
+// CPU cost of CmdBindPipeline switching between graphics states, compiled pipelines against shader objects.
+// Only binds are recorded, so the command buffers carry no work and are never submitted.
+// Arguments: <vertex.spv> <fragment.spv>, the vertex shader reads MeshVertexLayout like Shaders/Mesh.vert.
+static bool BenchStateChanges(uint32_t iterations, std::span<char*> args)
+{
+    std::vector<uint32_t> vertexSpirv;
+    std::vector<uint32_t> fragmentSpirv;
+    if (args.size() < 2 || !LoadSpirv(args[0], vertexSpirv) || !LoadSpirv(args[1], fragmentSpirv))
+    {
+        LOGE("state needs a vertex and a fragment shader: <vertex.spv> <fragment.spv>\n");
+        return false;
+    }
+
+    jobsystem::Initialize();
+    rhi::Startup();
+    rhi::Shader* vertexShader = rhi::CreateShader(vertexSpirv);
+    rhi::Shader* fragmentShader = rhi::CreateShader(fragmentSpirv);
+
+    const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    const uint32_t stateCount = 8;
+    const uint32_t bindsPerFrame = 16 * 1024;
+    for (bool shaderObjects : {false, true})
+    {
+        // Every state differs in something the pipeline bakes in
+        std::vector<rhi::Pipeline*> pipelines;
+        for (uint32_t i = 0; i < stateCount; ++i)
+        {
+            rhi::GraphicsPipelineDesc desc = {};
+            desc.vertexShader = vertexShader;
+            desc.fragmentShader = fragmentShader;
+            desc.colorFormats = std::span(&colorFormat, 1);
+            desc.depthFormat = VK_FORMAT_D32_SFLOAT;
+            rhi::SetVertexLayout<renderer::MeshVertexLayout>(desc);
+            desc.cullMode = (i & 1) ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+            desc.depthTest = (i & 2) == 0;
+            desc.depthWrite = (i & 4) == 0;
+            desc.shaderObjects = shaderObjects;
+            pipelines.push_back(rhi::CreateGraphicsPipeline(desc));
+        }
+
+        if (shaderObjects && pipelines[0]->shaderObjectCount == 0)
+        {
+            LOGW("Shader objects are unsupported on this device, skipped.\n");
+        }
+        else
+        {
+            double ns = 0.0;
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                rhi::CommandBuffer* cmd = rhi::GetCmdBuffer();
+                Clock::time_point start = Clock::now();
+                for (uint32_t j = 0; j < bindsPerFrame; ++j)
+                {
+                    rhi::CmdBindPipeline(cmd, pipelines[j % stateCount]);
+                }
+                ns += GetElapsedNs(start);
+                rhi::Submit();
+            }
+            LOGI("%s: %.1f ns per state change.\n", shaderObjects ? "Shader objects" : "Pipelines", ns / (double(iterations) * bindsPerFrame));
+        }
+
+        for (rhi::Pipeline* pipeline : pipelines)
+        {
+            rhi::DestroyPipeline(pipeline);
+        }
+    }
+
+    rhi::DestroyShader(vertexShader);
+    rhi::DestroyShader(fragmentShader);
+    rhi::Shutdown();
+    jobsystem::Shutdown();
+    return true;
+}
+
+// CPU cost of Submit() on frames without uploads, under the previous policy that submitted the empty copy queue
+// and made graphics wait on it, against the current one that skips both. Frames are either fully idle or record
+// one fill on the graphics queue. Submit() also waits for the frame MAX_FRAMES_IN_FLIGHT back, which the tiny
+// fills keep short.
+static bool BenchSubmit(uint32_t iterations, std::span<char*>)
+{
+    jobsystem::Initialize();
+    rhi::Startup();
+
+    rhi::BufferDesc bufferDesc = {};
+    bufferDesc.size = 256;
+    bufferDesc.memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY;
+    bufferDesc.bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    rhi::Buffer* buffer = rhi::CreateBuffer(bufferDesc);
+
+    const uint32_t framesPerIteration = 1000;
+    for (bool graphicsWork : {false, true})
+    {
+        for (bool submitIdleQueues : {true, false})
+        {
+            rhi::SetSubmitIdleQueues(submitIdleQueues);
+            double ns = 0.0;
+            for (uint32_t i = 0; i < iterations * framesPerIteration; ++i)
+            {
+                if (graphicsWork)
+                {
+                    rhi::CmdFillBuffer(rhi::GetCmdBuffer(rhi::QUEUE_GRAPHICS), buffer, 0, bufferDesc.size, i);
+                }
+                Clock::time_point start = Clock::now();
+                rhi::Submit();
+                ns += GetElapsedNs(start);
+            }
+            LOGI("%s frames, %s: %.0f ns per Submit().\n", graphicsWork ? "Graphics only" : "Idle",
+                 submitIdleQueues ? "empty copy submitted" : "empty copy skipped", ns / (double(iterations) * framesPerIteration));
+        }
+    }
+    rhi::SetSubmitIdleQueues(false);
+
+    rhi::DestroyBuffer(buffer);
+    rhi::Shutdown();
+    jobsystem::Shutdown();
+    return true;
+}
+
+struct Benchmark
+{
+    const char* name;
+    bool (*run)(uint32_t iterations, std::span<char*> args);
+};
+
+static const Benchmark s_benchmarks[] = {
+    {"jobs", BenchJobs},
+    {"state", BenchStateChanges},
+    {"submit", BenchSubmit},
+};
+
+int main(int argc, char** argv)
+{
+    const Benchmark* benchmark = nullptr;
+    for (const Benchmark& candidate : s_benchmarks)
+    {
+        if (argc > 1 && strcmp(argv[1], candidate.name) == 0)
+        {
+            benchmark = &candidate;
+        }
+    }
+
+    if (benchmark == nullptr)
+    {
+        LOGE("Usage: %s <benchmark> [iterations] [benchmark arguments]\n", argv[0]);
+        for (const Benchmark& candidate : s_benchmarks)
+        {
+            LOGE("    %s\n", candidate.name);
+        }
+        return 1;
+    }
+
+    uint32_t iterations = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 10;
+    std::span<char*> args = argc > 3 ? std::span(argv + 3, argc - 3) : std::span<char*>();
+    return benchmark->run(iterations > 0 ? iterations : 1, args) ? 0 : 1;
+}
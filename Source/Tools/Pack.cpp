@@ -0,0 +1,404 @@
+#include "Foundation/AssetPack.h"
+#include "Foundation/Compression.h"
+#include "RHI/RHI.h"
+#include "Renderer/MeshBuilder.h"
+
+#include <filesystem>
+#include <string.h>
+#include <unordered_map>
+
+// Packs loose files into an asset pack, see Foundation/AssetPack.h.
+// Assets are named by file name: .spv files become shaders, .dds files textures,
+// .mesh files meshes and anything else raw blobs. With --supercompress, RGBA8 textures are
+// supercompressed and transcoded to a block compressed format the device supports on load,
+// supercompressed textures can't be streamed. .obj files are imported into meshlet meshes,
+// see Renderer/MeshBuilder.h.
+//
+// Usage: BlastPack [--supercompress] <output pack> <input>...
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_FOURCC_DX10 0x30315844
+#define DDS_FOURCC_DXT1 0x31545844
+#define DDS_FOURCC_DXT5 0x35545844
+#define DDS_FOURCC_ATI2 0x32495441
+#define DDS_PIXEL_FORMAT_RGB 0x40
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved[11];
+    uint32_t pixelFormatSize;
+    uint32_t pixelFormatFlags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t masks[4];
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+struct DdsHeaderDX10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static VkFormat GetFormatFromDxgi(uint32_t dxgiFormat)
+{
+    switch (dxgiFormat)
+    {
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+{
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.resize(size);
+    bool read = fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return read;
+}
+
+// Repacks the mip chain of a 2D DDS texture with every mip aligned to ASSET_MIP_ALIGNMENT
+static bool PackTexture(const std::vector<uint8_t>& dds, bool supercompress, asset::AssetEntry& entry, std::vector<uint8_t>& blob)
+{
+    uint32_t magic = 0;
+    DdsHeader header = {};
+    if (dds.size() < sizeof(magic) + sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&magic, dds.data(), sizeof(magic));
+    memcpy(&header, dds.data() + sizeof(magic), sizeof(header));
+    size_t dataOffset = sizeof(magic) + sizeof(header);
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    switch (header.fourCC)
+    {
+        case DDS_FOURCC_DX10:
+        {
+            DdsHeaderDX10 dx10 = {};
+            if (dds.size() < dataOffset + sizeof(dx10))
+            {
+                return false;
+            }
+            memcpy(&dx10, dds.data() + dataOffset, sizeof(dx10));
+            dataOffset += sizeof(dx10);
+            format = dx10.arraySize <= 1 ? GetFormatFromDxgi(dx10.dxgiFormat) : VK_FORMAT_UNDEFINED;
+            break;
+        }
+        case DDS_FOURCC_DXT1: format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK; break;
+        case DDS_FOURCC_DXT5: format = VK_FORMAT_BC3_UNORM_BLOCK; break;
+        case DDS_FOURCC_ATI2: format = VK_FORMAT_BC5_UNORM_BLOCK; break;
+        default:
+            // Legacy uncompressed header, only the RGBA8 byte order maps to a Vulkan format
+            if ((header.pixelFormatFlags & DDS_PIXEL_FORMAT_RGB) && header.rgbBitCount == 32 && header.masks[0] == 0x000000ff
+                && header.masks[1] == 0x0000ff00 && header.masks[2] == 0x00ff0000 && header.masks[3] == 0xff000000)
+            {
+                format = VK_FORMAT_R8G8B8A8_UNORM;
+            }
+            break;
+    }
+
+    if (magic != DDS_MAGIC || format == VK_FORMAT_UNDEFINED || header.width == 0 || header.height == 0)
+    {
+        return false;
+    }
+
+    entry.type = asset::ASSET_TYPE_TEXTURE;
+    entry.format = format;
+    entry.width = header.width;
+    entry.height = header.height;
+    entry.mipCount = std::max(header.mipMapCount, 1u);
+
+    bool supercompressed = supercompress && (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB);
+    bool opaque = true;
+    size_t srcOffset = dataOffset;
+    for (uint32_t mip = 0; mip < entry.mipCount; ++mip)
+    {
+        size_t size = rhi::GetTextureDataSize(format, std::max(entry.width >> mip, 1u), std::max(entry.height >> mip, 1u));
+        if (srcOffset + size > dds.size())
+        {
+            return false;
+        }
+        for (size_t i = srcOffset + 3; supercompressed && opaque && i < srcOffset + size; i += 4)
+        {
+            opaque = dds[i] == 255;
+        }
+        blob.resize((blob.size() + ASSET_MIP_ALIGNMENT - 1) & ~size_t(ASSET_MIP_ALIGNMENT - 1));
+        blob.insert(blob.end(), dds.begin() + srcOffset, dds.begin() + srcOffset + size);
+        srcOffset += size;
+    }
+    blob.resize((blob.size() + ASSET_MIP_ALIGNMENT - 1) & ~size_t(ASSET_MIP_ALIGNMENT - 1));
+
+    if (supercompressed)
+    {
+        entry.flags = asset::ASSET_FLAG_SUPERCOMPRESSED | (opaque ? asset::ASSET_FLAG_OPAQUE : 0);
+
+        std::vector<uint8_t> compressed;
+        compression::CompressLZ(blob, compressed);
+        blob = std::move(compressed);
+    }
+    return true;
+}
+
+static int ParseObjIndex(const char* token, size_t count)
+{
+    int index = atoi(token);
+    // Negative indices count back from the last element read so far
+    return index < 0 ? static_cast<int>(count) + index : index - 1;
+}
+
+// Positions, normals and texture coordinates of triangle and polygon faces, polygons are fanned.
+// Missing normals and texture coordinates are zero.
+static bool ImportObj(const std::vector<uint8_t>& obj, std::vector<uint8_t>& blob)
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::vector<renderer::MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::unordered_map<std::string, uint32_t> vertexIndices;
+
+    std::string text(obj.begin(), obj.end());
+    size_t lineStart = 0;
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        lineEnd = lineEnd == std::string::npos ? text.size() : lineEnd;
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+        if (sscanf(line.c_str(), "v %f %f %f", &x, &y, &z) == 3)
+        {
+            positions.insert(positions.end(), {x, y, z});
+        }
+        else if (sscanf(line.c_str(), "vn %f %f %f", &x, &y, &z) == 3)
+        {
+            normals.insert(normals.end(), {x, y, z});
+        }
+        else if (sscanf(line.c_str(), "vt %f %f", &x, &y) == 2)
+        {
+            uvs.insert(uvs.end(), {x, y});
+        }
+        else if (line.starts_with("f "))
+        {
+            std::vector<uint32_t> face;
+            size_t tokenStart = line.find_first_not_of(" \t\r", 2);
+            while (tokenStart != std::string::npos)
+            {
+                size_t tokenEnd = std::min(line.find_first_of(" \t\r", tokenStart), line.size());
+                std::string vertexToken = line.substr(tokenStart, tokenEnd - tokenStart);
+                tokenStart = line.find_first_not_of(" \t\r", tokenEnd);
+
+                const char* token = vertexToken.c_str();
+                auto [it, inserted] = vertexIndices.emplace(vertexToken, static_cast<uint32_t>(vertices.size()));
+                if (inserted)
+                {
+                    renderer::MeshVertex vertex = {};
+                    int position = ParseObjIndex(token, positions.size() / 3);
+                    if (position < 0 || static_cast<size_t>(position) >= positions.size() / 3)
+                    {
+                        return false;
+                    }
+                    std::copy_n(&positions[position * 3], 3, vertex.position);
+
+                    const char* uvToken = strchr(token, '/');
+                    if (uvToken != nullptr && uvToken[1] != '/' && uvToken[1] != '\0')
+                    {
+                        int uv = ParseObjIndex(uvToken + 1, uvs.size() / 2);
+                        if (uv >= 0 && static_cast<size_t>(uv) < uvs.size() / 2)
+                        {
+                            std::copy_n(&uvs[uv * 2], 2, vertex.uv);
+                        }
+                    }
+                    const char* normalToken = uvToken != nullptr ? strchr(uvToken + 1, '/') : nullptr;
+                    if (normalToken != nullptr)
+                    {
+                        int normal = ParseObjIndex(normalToken + 1, normals.size() / 3);
+                        if (normal >= 0 && static_cast<size_t>(normal) < normals.size() / 3)
+                        {
+                            std::copy_n(&normals[normal * 3], 3, vertex.normal);
+                        }
+                    }
+                    vertices.push_back(vertex);
+                }
+                face.push_back(it->second);
+            }
+
+            for (size_t i = 2; i < face.size(); ++i)
+            {
+                indices.insert(indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+
+    if (indices.empty())
+    {
+        return false;
+    }
+    renderer::BuildMesh(vertices, indices, blob);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int firstArg = 1;
+    bool supercompress = argc > 1 && strcmp(argv[1], "--supercompress") == 0;
+    if (supercompress)
+    {
+        ++firstArg;
+    }
+    if (argc < firstArg + 2)
+    {
+        LOGE("Usage: %s [--supercompress] <output pack> <input>...\n", argv[0]);
+        return 1;
+    }
+
+    const char* outputPath = argv[firstArg];
+    FILE* output = fopen(outputPath, "wb");
+    if (output == nullptr)
+    {
+        LOGE("Failed to open %s.\n", outputPath);
+        return 1;
+    }
+
+    asset::PackHeader header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    fwrite(&header, sizeof(header), 1, output);
+    uint64_t offset = sizeof(header);
+
+    static const uint8_t zeros[ASSET_BLOB_ALIGNMENT] = {};
+    std::vector<asset::AssetEntry> entries;
+    for (int i = firstArg + 1; i < argc; ++i)
+    {
+        std::filesystem::path path = argv[i];
+        std::vector<uint8_t> data;
+        if (!ReadFile(path, data))
+        {
+            LOGE("Failed to read %s.\n", argv[i]);
+            fclose(output);
+            return 1;
+        }
+
+        asset::AssetEntry entry = {};
+        entry.nameHash = asset::HashAssetName(path.filename().string());
+        entry.type = asset::ASSET_TYPE_RAW;
+
+        std::vector<uint8_t> blob;
+        std::filesystem::path extension = path.extension();
+        if (extension == ".dds")
+        {
+            if (!PackTexture(data, supercompress, entry, blob))
+            {
+                LOGE("Unsupported texture %s, only 2D BC and RGBA8 DDS files are packed.\n", argv[i]);
+                fclose(output);
+                return 1;
+            }
+        }
+        else if (extension == ".obj")
+        {
+            entry.type = asset::ASSET_TYPE_MESH;
+            if (!ImportObj(data, blob))
+            {
+                LOGE("Failed to import %s, it has no valid faces.\n", argv[i]);
+                fclose(output);
+                return 1;
+            }
+            const renderer::MeshHeader* mesh = renderer::GetMeshHeader(blob);
+            LOGI("Imported %s: %u vertices, %u triangles, %u meshlets.\n", argv[i],
+                 mesh->vertexCount, mesh->indexCount / 3, mesh->meshletCount);
+        }
+        else
+        {
+            if (extension == ".spv")
+            {
+                entry.type = asset::ASSET_TYPE_SHADER;
+            }
+            else if (extension == ".mesh")
+            {
+                entry.type = asset::ASSET_TYPE_MESH;
+            }
+            blob = std::move(data);
+        }
+
+        uint64_t padding = (ASSET_BLOB_ALIGNMENT - offset % ASSET_BLOB_ALIGNMENT) % ASSET_BLOB_ALIGNMENT;
+        fwrite(zeros, 1, padding, output);
+        offset += padding;
+
+        entry.offset = offset;
+        entry.size = blob.size();
+        fwrite(blob.data(), 1, blob.size(), output);
+        offset += blob.size();
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const asset::AssetEntry& a, const asset::AssetEntry& b) { return a.nameHash < b.nameHash; });
+    for (size_t i = 1; i < entries.size(); ++i)
+    {
+        if (entries[i].nameHash == entries[i - 1].nameHash)
+        {
+            LOGE("Two inputs share the name hash %016llx, asset names must be unique.\n", (unsigned long long)entries[i].nameHash);
+            fclose(output);
+            return 1;
+        }
+    }
+
+    uint64_t padding = (alignof(asset::AssetEntry) - offset % alignof(asset::AssetEntry)) % alignof(asset::AssetEntry);
+    fwrite(zeros, 1, padding, output);
+    offset += padding;
+    fwrite(entries.data(), sizeof(asset::AssetEntry), entries.size(), output);
+
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.tocOffset = offset;
+    fseek(output, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, output);
+    bool written = ferror(output) == 0;
+    fclose(output);
+
+    if (!written)
+    {
+        LOGE("Failed to write %s.\n", outputPath);
+        return 1;
+    }
+    LOGI("Packed %zu assets into %s (%llu bytes).\n", entries.size(), outputPath,
+         (unsigned long long)(offset + entries.size() * sizeof(asset::AssetEntry)));
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "Foundation/JobSystem.h"
+#include "RHI/RHI.h"
+
+#include <chrono>
+#include <filesystem>
+
+// Compiles every pipeline of a recorded state list against the local device and
+// writes the warmed pipeline cache, meant to run at install time.
+//
+// Usage: BlastPrecompile <shader dir> <state list> <output cache> [report.csv]
+
+static bool LoadSpirv(const std::filesystem::path& path, std::vector<uint32_t>& spirv)
+{
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    spirv.resize(size / sizeof(uint32_t));
+    bool read = size % sizeof(uint32_t) == 0 && fread(spirv.data(), sizeof(uint32_t), spirv.size(), file) == spirv.size();
+    fclose(file);
+    return read;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        LOGE("Usage: %s <shader dir> <state list> <output cache> [report.csv]\n", argv[0]);
+        return 1;
+    }
+
+    const char* shaderDir = argv[1];
+    const char* stateListPath = argv[2];
+    const char* cachePath = argv[3];
+    const char* reportPath = argc > 4 ? argv[4] : nullptr;
+
+    std::vector<rhi::PipelineStateRecord> records;
+    if (!rhi::LoadPipelineStateList(stateListPath, records))
+    {
+        LOGE("Failed to load pipeline state list %s.\n", stateListPath);
+        return 1;
+    }
+
+    jobsystem::Initialize();
+    rhi::Startup();
+    // Start from the existing blob so reruns only add what is missing
+    rhi::LoadPipelineCache(cachePath);
+
+    // Records refer to shaders by the hash of their SPIR-V
+    std::vector<rhi::Shader*> shaders;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(shaderDir))
+    {
+        std::vector<uint32_t> spirv;
+        if (entry.path().extension() != ".spv" || !LoadSpirv(entry.path(), spirv))
+        {
+            continue;
+        }
+
+        if (rhi::Shader* shader = rhi::CreateShader(spirv))
+        {
+            shaders.push_back(shader);
+        }
+    }
+    LOGI("Loaded %zu shaders from %s.\n", shaders.size(), shaderDir);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<rhi::Pipeline*> pipelines(records.size(), nullptr);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        rhi::GraphicsPipelineDesc desc = rhi::GetGraphicsPipelineDesc(records[i].key, shaders);
+        if (desc.vertexShader == nullptr && desc.meshShader == nullptr)
+        {
+            LOGW("Skipping pipeline %zu, its shaders are missing.\n", i);
+            continue;
+        }
+        if (desc.meshShader != nullptr && !rhi::IsMeshShaderSupported())
+        {
+            LOGW("Skipping pipeline %zu, mesh shaders are unsupported.\n", i);
+            continue;
+        }
+
+        // Shader objects never touch the pipeline cache, warm the pipeline path instead
+        desc.shaderObjects = false;
+        pipelines[i] = rhi::CreateGraphicsPipelineAsync(desc);
+    }
+    rhi::WaitForPipelines();
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    rhi::PipelineCacheStats stats = rhi::GetPipelineCacheStats();
+    LOGI("Compiled %zu pipelines in %.1f ms (%.1f ms of compile time on %u threads).\n",
+         records.size(), elapsed.count(), stats.compileTimeNs / 1e6, jobsystem::GetThreadCount());
+
+    FILE* report = reportPath != nullptr ? fopen(reportPath, "w") : nullptr;
+    if (report != nullptr)
+    {
+        fprintf(report, "index,state_hash,first_frame,compile_ms\n");
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (pipelines[i] != nullptr)
+            {
+                fprintf(report, "%zu,%016llx,%llu,%.3f\n", i,
+                        (unsigned long long)rhi::HashPipelineState(records[i].key),
+                        (unsigned long long)records[i].firstFrame,
+                        pipelines[i]->compileTimeNs / 1e6);
+            }
+        }
+        fclose(report);
+    }
+    else if (reportPath != nullptr)
+    {
+        LOGE("Failed to open report %s.\n", reportPath);
+    }
+
+    bool saved = rhi::SavePipelineCache(cachePath);
+
+    for (rhi::Pipeline* pipeline : pipelines)
+    {
+        rhi::DestroyPipeline(pipeline);
+    }
+    for (rhi::Shader* shader : shaders)
+    {
+        rhi::DestroyShader(shader);
+    }
+
+    rhi::Shutdown();
+    jobsystem::Shutdown();
+    return saved ? 0 : 1;
+}
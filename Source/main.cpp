@@ -1,8 +1,20 @@
+#include "Foundation/AsyncIO.h"
+#include "Foundation/JobSystem.h"
 #include "RHI/RHI.h"
 
+#define PIPELINE_CACHE_PATH "PipelineCache.bin"
+
 int main()
 {
+    jobsystem::Initialize();
+    asyncio::Initialize();
     rhi::Startup();
+    rhi::LoadPipelineCache(PIPELINE_CACHE_PATH);
+
+    rhi::WaitForPipelines();
+    rhi::SavePipelineCache(PIPELINE_CACHE_PATH);
+    asyncio::Shutdown();
     rhi::Shutdown();
+    jobsystem::Shutdown();
     return 0;
 }